@@ -10,9 +10,13 @@
  * GNU General Public License for more details.
 */
 
+#include <algorithm>
+#include <map>
+#include <Windows.h>
 #include "public_errors.h"
 #include "public_rare_definitions.h"
-#include "rapidjson/document.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
 #include "commands.h"
 #include "globals.h"
 #include "stringutils.h"
@@ -20,6 +24,367 @@ using namespace std;
 
 namespace Commands {
 
+	/* Remembers the peers that use an older protocol version, every other peer is assumed to understand the current one */
+	class PeerProtocolVersions {
+
+	private:
+		std::map<std::pair<uint64, anyID>, int> legacyPeers;
+		CRITICAL_SECTION cs;
+
+	public:
+		PeerProtocolVersions() { InitializeCriticalSection(&cs); }
+		~PeerProtocolVersions() { DeleteCriticalSection(&cs); }
+
+		void set(uint64 serverConnectionHandlerID, anyID clientID, int protocolVersion) {
+			EnterCriticalSection(&cs);
+			if (protocolVersion < PROTOCOL_VERSION) {
+				legacyPeers[make_pair(serverConnectionHandlerID, clientID)] = protocolVersion;
+			} else {
+				legacyPeers.erase(make_pair(serverConnectionHandlerID, clientID));
+			}
+			LeaveCriticalSection(&cs);
+		}
+
+		int get(uint64 serverConnectionHandlerID, anyID clientID) {
+			EnterCriticalSection(&cs);
+			map<pair<uint64, anyID>, int>::iterator it = legacyPeers.find(make_pair(serverConnectionHandlerID, clientID));
+			int protocolVersion = it != legacyPeers.end() ? it->second : PROTOCOL_VERSION;
+			LeaveCriticalSection(&cs);
+			return protocolVersion;
+		}
+
+		void getLegacyPeers(uint64 serverConnectionHandlerID, vector<anyID>& clientIDs) {
+			EnterCriticalSection(&cs);
+			map<pair<uint64, anyID>, int>::iterator it = legacyPeers.lower_bound(make_pair(serverConnectionHandlerID, (anyID)0));
+			for (; it != legacyPeers.end() && it->first.first == serverConnectionHandlerID; it++) {
+				clientIDs.push_back(it->first.second);
+			}
+			LeaveCriticalSection(&cs);
+		}
+
+		void remove(uint64 serverConnectionHandlerID, anyID clientID) {
+			EnterCriticalSection(&cs);
+			legacyPeers.erase(make_pair(serverConnectionHandlerID, clientID));
+			LeaveCriticalSection(&cs);
+		}
+
+		void removeAll(uint64 serverConnectionHandlerID) {
+			EnterCriticalSection(&cs);
+			map<pair<uint64, anyID>, int>::iterator begin = legacyPeers.lower_bound(make_pair(serverConnectionHandlerID, (anyID)0));
+			map<pair<uint64, anyID>, int>::iterator end = begin;
+			while (end != legacyPeers.end() && end->first.first == serverConnectionHandlerID)
+				end++;
+			legacyPeers.erase(begin, end);
+			LeaveCriticalSection(&cs);
+		}
+
+	};
+
+	static PeerProtocolVersions peerProtocolVersions;
+
+
+	/* The last broadcast state per server, which is the base of the next delta */
+	class TransmitStates {
+
+	private:
+		struct TransmitState {
+			Gw2Info gw2Info;
+			uint32_t sequence;
+			int deltasSinceKeyframe;
+			std::vector<anyID> recipients; // Sorted, the clients that hold the last broadcast state
+		};
+
+		std::map<uint64, TransmitState> states;
+		CRITICAL_SECTION cs;
+
+	public:
+		TransmitStates() { InitializeCriticalSection(&cs); }
+		~TransmitStates() { DeleteCriticalSection(&cs); }
+
+		/*
+		 * Stores the new state and returns the fields that have to be broadcast, 0 if nothing changed.
+		 * Recipients that didn't receive the previous broadcast are returned in newRecipients, they need a keyframe instead of a delta.
+		 */
+		int update(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, bool keyframe, const vector<anyID>& recipients, uint32_t& sequence, vector<anyID>& newRecipients) {
+			EnterCriticalSection(&cs);
+			map<uint64, TransmitState>::iterator it = states.find(serverConnectionHandlerID);
+			int fields;
+			if (it == states.end()) {
+				TransmitState state;
+				state.sequence = 0;
+				state.deltasSinceKeyframe = 0;
+				it = states.insert(make_pair(serverConnectionHandlerID, state)).first;
+				fields = GW2INFO_KEYFRAME | GW2INFO_FIELDS_ALL;
+			} else if (keyframe || it->second.deltasSinceKeyframe >= GW2INFO_KEYFRAME_INTERVAL || gw2Info.characterName.empty()) {
+				// Going offline is always a keyframe, it's the last update that receivers get for a while
+				fields = GW2INFO_KEYFRAME | GW2INFO_FIELDS_ALL;
+			} else {
+				fields = gw2Info.getChangedFields(it->second.gw2Info);
+			}
+
+			if (fields != 0) {
+				TransmitState& state = it->second;
+				state.gw2Info = gw2Info;
+				state.sequence++;
+				state.deltasSinceKeyframe = (fields & GW2INFO_KEYFRAME) ? 0 : state.deltasSinceKeyframe + 1;
+				sequence = state.sequence;
+				if (!(fields & GW2INFO_KEYFRAME)) {
+					set_difference(recipients.begin(), recipients.end(), state.recipients.begin(), state.recipients.end(), back_inserter(newRecipients));
+				}
+				state.recipients = recipients;
+			}
+			LeaveCriticalSection(&cs);
+			return fields;
+		}
+
+		/* Gets the last broadcast state, so that a keyframe sent to a single client is a valid base for the following deltas */
+		bool get(uint64 serverConnectionHandlerID, Gw2Info& gw2Info, uint32_t& sequence) {
+			EnterCriticalSection(&cs);
+			map<uint64, TransmitState>::iterator it = states.find(serverConnectionHandlerID);
+			bool found = it != states.end();
+			if (found) {
+				gw2Info = it->second.gw2Info;
+				sequence = it->second.sequence;
+			}
+			LeaveCriticalSection(&cs);
+			return found;
+		}
+
+		/* Marks clients as holding the last broadcast state, after they received it as a keyframe */
+		void addRecipients(uint64 serverConnectionHandlerID, const vector<anyID>& clientIDs) {
+			EnterCriticalSection(&cs);
+			map<uint64, TransmitState>::iterator it = states.find(serverConnectionHandlerID);
+			if (it != states.end()) {
+				vector<anyID> merged;
+				vector<anyID> sortedIDs = clientIDs;
+				sort(sortedIDs.begin(), sortedIDs.end());
+				set_union(it->second.recipients.begin(), it->second.recipients.end(), sortedIDs.begin(), sortedIDs.end(), back_inserter(merged));
+				it->second.recipients.swap(merged);
+			}
+			LeaveCriticalSection(&cs);
+		}
+
+		void remove(uint64 serverConnectionHandlerID) {
+			EnterCriticalSection(&cs);
+			states.erase(serverConnectionHandlerID);
+			LeaveCriticalSection(&cs);
+		}
+
+	};
+
+	static TransmitStates transmitStates;
+
+
+	/* Clients that recently requested our info, they keep receiving our updates for a while even if they're not in our channel */
+	class Subscriptions {
+
+	private:
+		std::map<std::pair<uint64, anyID>, DWORD> subscribeTimes;
+		CRITICAL_SECTION cs;
+
+	public:
+		Subscriptions() { InitializeCriticalSection(&cs); }
+		~Subscriptions() { DeleteCriticalSection(&cs); }
+
+		void subscribe(uint64 serverConnectionHandlerID, anyID clientID) {
+			EnterCriticalSection(&cs);
+			subscribeTimes[make_pair(serverConnectionHandlerID, clientID)] = GetTickCount();
+			LeaveCriticalSection(&cs);
+		}
+
+		/* Appends the active subscribers of a server in ascending order and forgets the expired ones */
+		void getSubscribers(uint64 serverConnectionHandlerID, vector<anyID>& clientIDs) {
+			EnterCriticalSection(&cs);
+			DWORD now = GetTickCount();
+			map<pair<uint64, anyID>, DWORD>::iterator it = subscribeTimes.lower_bound(make_pair(serverConnectionHandlerID, (anyID)0));
+			while (it != subscribeTimes.end() && it->first.first == serverConnectionHandlerID) {
+				if (now - it->second >= GW2INFO_SUBSCRIPTION_DURATION) {
+					subscribeTimes.erase(it++);
+				} else {
+					clientIDs.push_back(it->first.second);
+					it++;
+				}
+			}
+			LeaveCriticalSection(&cs);
+		}
+
+		void remove(uint64 serverConnectionHandlerID, anyID clientID) {
+			EnterCriticalSection(&cs);
+			subscribeTimes.erase(make_pair(serverConnectionHandlerID, clientID));
+			LeaveCriticalSection(&cs);
+		}
+
+		void removeAll(uint64 serverConnectionHandlerID) {
+			EnterCriticalSection(&cs);
+			map<pair<uint64, anyID>, DWORD>::iterator begin = subscribeTimes.lower_bound(make_pair(serverConnectionHandlerID, (anyID)0));
+			map<pair<uint64, anyID>, DWORD>::iterator end = begin;
+			while (end != subscribeTimes.end() && end->first.first == serverConnectionHandlerID)
+				end++;
+			subscribeTimes.erase(begin, end);
+			LeaveCriticalSection(&cs);
+		}
+
+	};
+
+	static Subscriptions subscriptions;
+
+
+	/* Remembers when something was last sent to a client, to limit how often that happens */
+	class ClientRateLimit {
+
+	private:
+		std::map<std::pair<uint64, anyID>, DWORD> lastTimes;
+		CRITICAL_SECTION cs;
+
+	public:
+		ClientRateLimit() { InitializeCriticalSection(&cs); }
+		~ClientRateLimit() { DeleteCriticalSection(&cs); }
+
+		/* Remembers the current time regardless of the last time */
+		void touch(uint64 serverConnectionHandlerID, anyID clientID) {
+			EnterCriticalSection(&cs);
+			lastTimes[make_pair(serverConnectionHandlerID, clientID)] = GetTickCount();
+			LeaveCriticalSection(&cs);
+		}
+
+		/* Returns true and remembers the current time if the interval since the last time has passed */
+		bool tryAcquire(uint64 serverConnectionHandlerID, anyID clientID, DWORD interval) {
+			EnterCriticalSection(&cs);
+			DWORD now = GetTickCount();
+			map<pair<uint64, anyID>, DWORD>::iterator it = lastTimes.find(make_pair(serverConnectionHandlerID, clientID));
+			bool acquired = it == lastTimes.end() || now - it->second >= interval;
+			if (acquired)
+				lastTimes[make_pair(serverConnectionHandlerID, clientID)] = now;
+			LeaveCriticalSection(&cs);
+			return acquired;
+		}
+
+		void remove(uint64 serverConnectionHandlerID, anyID clientID) {
+			EnterCriticalSection(&cs);
+			lastTimes.erase(make_pair(serverConnectionHandlerID, clientID));
+			LeaveCriticalSection(&cs);
+		}
+
+		void removeAll(uint64 serverConnectionHandlerID) {
+			EnterCriticalSection(&cs);
+			map<pair<uint64, anyID>, DWORD>::iterator begin = lastTimes.lower_bound(make_pair(serverConnectionHandlerID, (anyID)0));
+			map<pair<uint64, anyID>, DWORD>::iterator end = begin;
+			while (end != lastTimes.end() && end->first.first == serverConnectionHandlerID)
+				end++;
+			lastTimes.erase(begin, end);
+			LeaveCriticalSection(&cs);
+		}
+
+	};
+
+	static ClientRateLimit requestRateLimit;
+	static ClientRateLimit keyframeRequestRateLimit;
+	static ClientRateLimit replyRateLimit;
+	static ClientRateLimit subscriptionRenewals; // When we last requested the info of a client, which subscribed us to it
+
+
+	/* Collects the clients that requested our info per server, so that requests arriving at about the same time are answered together */
+	class PendingReplies {
+
+	private:
+		struct PendingReply {
+			DWORD firstRequestTime;
+			std::vector<anyID> clientIDs;
+		};
+
+		std::map<uint64, PendingReply> pending;
+		CRITICAL_SECTION cs;
+
+	public:
+		PendingReplies() { InitializeCriticalSection(&cs); }
+		~PendingReplies() { DeleteCriticalSection(&cs); }
+
+		void add(uint64 serverConnectionHandlerID, anyID clientID) {
+			EnterCriticalSection(&cs);
+			PendingReply& reply = pending[serverConnectionHandlerID];
+			if (reply.clientIDs.empty())
+				reply.firstRequestTime = GetTickCount();
+			if (find(reply.clientIDs.begin(), reply.clientIDs.end(), clientID) == reply.clientIDs.end())
+				reply.clientIDs.push_back(clientID);
+			LeaveCriticalSection(&cs);
+		}
+
+		/* Takes the requesters of one server whose coalescing window has passed, returns false if there are none */
+		bool takeDue(uint64& serverConnectionHandlerID, vector<anyID>& clientIDs) {
+			bool found = false;
+			EnterCriticalSection(&cs);
+			DWORD now = GetTickCount();
+			for (map<uint64, PendingReply>::iterator it = pending.begin(); it != pending.end(); it++) {
+				if (now - it->second.firstRequestTime >= REQUESTGW2INFO_COALESCE_WINDOW) {
+					serverConnectionHandlerID = it->first;
+					clientIDs.swap(it->second.clientIDs);
+					pending.erase(it);
+					found = true;
+					break;
+				}
+			}
+			LeaveCriticalSection(&cs);
+			return found;
+		}
+
+		void remove(uint64 serverConnectionHandlerID, anyID clientID) {
+			EnterCriticalSection(&cs);
+			map<uint64, PendingReply>::iterator it = pending.find(serverConnectionHandlerID);
+			if (it != pending.end()) {
+				vector<anyID>& clientIDs = it->second.clientIDs;
+				clientIDs.erase(std::remove(clientIDs.begin(), clientIDs.end(), clientID), clientIDs.end());
+				if (clientIDs.empty())
+					pending.erase(it);
+			}
+			LeaveCriticalSection(&cs);
+		}
+
+		void removeAll(uint64 serverConnectionHandlerID) {
+			EnterCriticalSection(&cs);
+			pending.erase(serverConnectionHandlerID);
+			LeaveCriticalSection(&cs);
+		}
+
+	};
+
+	static PendingReplies pendingReplies;
+
+
+	/* Builds GW2Info commands for legacy peers in a buffer that keeps its capacity between commands */
+	class JsonCommandWriter {
+
+	private:
+		rapidjson::StringBuffer buffer;
+		rapidjson::Writer<rapidjson::StringBuffer> writer;
+		CRITICAL_SECTION cs;
+
+		void put(const char* s) {
+			for (; *s != 0; s++)
+				buffer.Put(*s);
+		}
+
+	public:
+		JsonCommandWriter() : writer(buffer) { InitializeCriticalSection(&cs); }
+		~JsonCommandWriter() { DeleteCriticalSection(&cs); }
+
+		void send(uint64 serverConnectionHandlerID, anyID myID, const Gw2Info& gw2Info, const anyID* targetIDs) {
+			char clientID[16];
+			sprintf_s(clientID, "%u", (unsigned)myID);
+
+			EnterCriticalSection(&cs);
+			buffer.Clear();
+			put("GW2Info ");
+			put(clientID);
+			put(" ");
+			gw2Info.toJson(writer);
+			Globals::ts3Functions.sendPluginCommand(serverConnectionHandlerID, Globals::pluginID, buffer.GetString(), PluginCommandTarget_CLIENT, targetIDs, NULL);
+			LeaveCriticalSection(&cs);
+		}
+
+	};
+
+	static JsonCommandWriter jsonCommandWriter;
+
 	bool getOwnClientID(uint64 serverConnectionHandlerID, anyID* myID) {
 		if (!Globals::pluginID) {
 			debuglog("GW2Plugin: Plugin not registered, unable to get own ID\n");
@@ -33,24 +398,36 @@ namespace Commands {
 		return true;
 	}
 
-	bool parseCommand(const string& command, CommandType& commandType, vector<string>& commandParameters) {
-		commandType = CMD_NONE;
-		vector<string> s = split(string(command), ' ', 2);
-		vector<string> params;
-		if (s.size() > 0) {
-			if (s.at(0) == "GW2Info") {
-				commandType = CMD_GW2INFO;
-				if (s.size() > 1)
-					params = split(s.at(1), ' ', 2);
-			} else if (s.at(0) == "RequestGW2Info") {
-				commandType = CMD_REQUESTGW2INFO;
-				if (s.size() > 1)
-					params.push_back(s.at(1));
-			} else {
-				return false;
-			}
+	bool parseCommand(const char* command, Command& result) {
+		result.type = CMD_NONE;
+		result.parameterCount = 0;
+
+		StringRef tokens[2];
+		size_t tokenCount = split(command, ' ', 2, tokens);
+		if (tokenCount == 0)
+			return true;
+
+		const StringRef& name = tokens[0];
+		switch (name.data[0]) {
+			case 'G':
+				if (name.equals("GW2Info")) {
+					result.type = CMD_GW2INFO;
+				} else if (name.equals("GW2InfoCompact")) {
+					result.type = CMD_GW2INFOCOMPACT;
+				}
+				break;
+			case 'R':
+				if (name.equals("RequestGW2Info"))
+					result.type = CMD_REQUESTGW2INFO;
+				break;
 		}
-		commandParameters = params;
+		if (result.type == CMD_NONE)
+			return false;
+
+		// The remainder is zero-terminated, because it ends where the command ends; the data of GW2Info commands may contain spaces
+		size_t maxParameters = result.type == CMD_REQUESTGW2INFO ? COMMAND_MAX_PARAMETERS : 2;
+		if (tokenCount > 1)
+			result.parameterCount = split(tokens[1].data, ' ', maxParameters, result.parameters);
 		return true;
 	}
 
@@ -64,28 +441,212 @@ namespace Commands {
 			case CMD_REQUESTGW2INFO:
 				command = "RequestGW2Info";
 				break;
+			case CMD_GW2INFOCOMPACT:
+				command = "GW2InfoCompact";
+				break;
 		}
 
 		command += " " + parameters;
 		Globals::ts3Functions.sendPluginCommand(serverConnectionHandlerID, Globals::pluginID, command.c_str(), targetMode, targetIDs, returnCode);
 	}
 
-	void requestGW2Info(uint64 serverConnectionHandlerID, int targetMode, const anyID* targetIDs) {
+	void requestGW2Info(uint64 serverConnectionHandlerID, int targetMode, const anyID* targetIDs, int flags) {
 		anyID myID;
 		if (!getOwnClientID(serverConnectionHandlerID, &myID))
 			return;
 
-		string parameters = to_string(myID);
-		send(serverConnectionHandlerID, CMD_REQUESTGW2INFO, parameters, PluginCommandTarget_SERVER, targetIDs, NULL);
+		/* Older plugin versions only read the client ID and ignore the protocol version and flags */
+		string parameters = to_string(myID) + " " + to_string(PROTOCOL_VERSION);
+		if (flags != 0)
+			parameters += " " + to_string(flags);
+		send(serverConnectionHandlerID, CMD_REQUESTGW2INFO, parameters, targetMode, targetIDs, NULL);
+
+		if (targetMode == PluginCommandTarget_CLIENT) {
+			for (const anyID* id = targetIDs; *id != 0; id++)
+				subscriptionRenewals.touch(serverConnectionHandlerID, *id);
+		}
+	}
+
+	static bool isInOwnChannel(uint64 serverConnectionHandlerID, anyID clientID) {
+		anyID myID;
+		uint64 myChannelID, channelID;
+		return getOwnClientID(serverConnectionHandlerID, &myID) &&
+			Globals::ts3Functions.getChannelOfClient(serverConnectionHandlerID, myID, &myChannelID) == ERROR_ok &&
+			Globals::ts3Functions.getChannelOfClient(serverConnectionHandlerID, clientID, &channelID) == ERROR_ok &&
+			myChannelID == channelID;
 	}
 
-	void sendGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, int targetMode, const anyID* targetIDs) {
+	/* Collects the clients in our own channel and the subscribers, sorted and without ourselves and legacy peers */
+	static void getInterestedClients(uint64 serverConnectionHandlerID, anyID myID, const vector<anyID>& legacyIDs, vector<anyID>& clientIDs) {
+		vector<anyID> candidates;
+		uint64 channelID;
+		anyID* channelClients;
+		if (Globals::ts3Functions.getChannelOfClient(serverConnectionHandlerID, myID, &channelID) == ERROR_ok &&
+			Globals::ts3Functions.getChannelClientList(serverConnectionHandlerID, channelID, &channelClients) == ERROR_ok) {
+			for (anyID* id = channelClients; *id != 0; id++) {
+				if (*id != myID)
+					candidates.push_back(*id);
+			}
+			Globals::ts3Functions.freeMemory(channelClients);
+		}
+		subscriptions.getSubscribers(serverConnectionHandlerID, candidates);
+
+		sort(candidates.begin(), candidates.end());
+		candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+		set_difference(candidates.begin(), candidates.end(), legacyIDs.begin(), legacyIDs.end(), back_inserter(clientIDs));
+	}
+
+	static void transmitGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, int targetMode, const anyID* targetIDs, bool keyframe) {
 		anyID myID;
 		if (!getOwnClientID(serverConnectionHandlerID, &myID))
 			return;
 
-		string parameters = to_string(myID) + " " + gw2Info.toJson().c_str();
-		send(serverConnectionHandlerID, CMD_GW2INFO, parameters, PluginCommandTarget_SERVER, targetIDs, NULL);
+		vector<anyID> legacyIDs;
+		if (targetMode == PluginCommandTarget_CLIENT) {
+			vector<anyID> currentIDs;
+			for (const anyID* id = targetIDs; id != NULL && *id != 0; id++) {
+				if (peerProtocolVersions.get(serverConnectionHandlerID, *id) < PROTOCOL_VERSION_COMPACT) {
+					legacyIDs.push_back(*id);
+				} else {
+					currentIDs.push_back(*id);
+				}
+			}
+			if (!currentIDs.empty()) {
+				// Before the first broadcast there are no deltas yet that could follow up on the keyframe
+				Gw2Info base = gw2Info;
+				uint32_t sequence = 0;
+				if (transmitStates.get(serverConnectionHandlerID, base, sequence))
+					transmitStates.addRecipients(serverConnectionHandlerID, currentIDs);
+				currentIDs.push_back(0);
+				send(serverConnectionHandlerID, CMD_GW2INFOCOMPACT, to_string(myID) + " " + base.toCompact(sequence, GW2INFO_KEYFRAME | GW2INFO_FIELDS_ALL),
+					PluginCommandTarget_CLIENT, &currentIDs[0], NULL);
+			}
+		} else {
+			// Legacy peers don't subscribe, they keep receiving every update like they used to
+			peerProtocolVersions.getLegacyPeers(serverConnectionHandlerID, legacyIDs);
+			vector<anyID> recipients;
+			getInterestedClients(serverConnectionHandlerID, myID, legacyIDs, recipients);
+
+			uint32_t sequence;
+			vector<anyID> newRecipients;
+			int fields = transmitStates.update(serverConnectionHandlerID, gw2Info, keyframe, recipients, sequence, newRecipients);
+			if (fields == 0)
+				return;
+
+			if (!newRecipients.empty()) {
+				vector<anyID> deltaRecipients;
+				set_difference(recipients.begin(), recipients.end(), newRecipients.begin(), newRecipients.end(), back_inserter(deltaRecipients));
+				recipients.swap(deltaRecipients);
+				newRecipients.push_back(0);
+				send(serverConnectionHandlerID, CMD_GW2INFOCOMPACT, to_string(myID) + " " + gw2Info.toCompact(sequence, GW2INFO_KEYFRAME | GW2INFO_FIELDS_ALL),
+					PluginCommandTarget_CLIENT, &newRecipients[0], NULL);
+			}
+			if (!recipients.empty()) {
+				recipients.push_back(0);
+				send(serverConnectionHandlerID, CMD_GW2INFOCOMPACT, to_string(myID) + " " + gw2Info.toCompact(sequence, fields), PluginCommandTarget_CLIENT, &recipients[0], NULL);
+			}
+		}
+
+		if (!legacyIDs.empty()) {
+			legacyIDs.push_back(0);
+			jsonCommandWriter.send(serverConnectionHandlerID, myID, gw2Info, &legacyIDs[0]);
+		}
+	}
+
+	void sendGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, int targetMode, const anyID* targetIDs) {
+		transmitGW2Info(serverConnectionHandlerID, gw2Info, targetMode, targetIDs, false);
+	}
+
+	bool requestGW2InfoFromClient(uint64 serverConnectionHandlerID, anyID clientID) {
+		if (!requestRateLimit.tryAcquire(serverConnectionHandlerID, clientID, REQUESTGW2INFO_REQUEST_INTERVAL)) {
+			debuglog("GW2Plugin: Already requested info from client %d recently\n", clientID);
+			return false;
+		}
+		anyID targetIDs[] = { clientID, 0 };
+		requestGW2Info(serverConnectionHandlerID, PluginCommandTarget_CLIENT, targetIDs, 0);
+		return true;
+	}
+
+	bool requestGW2InfoKeyframeFromClient(uint64 serverConnectionHandlerID, anyID clientID) {
+		if (!keyframeRequestRateLimit.tryAcquire(serverConnectionHandlerID, clientID, REQUESTGW2INFO_KEYFRAME_REQUEST_INTERVAL)) {
+			debuglog("GW2Plugin: Already requested a keyframe from client %d recently\n", clientID);
+			return false;
+		}
+		anyID targetIDs[] = { clientID, 0 };
+		requestGW2Info(serverConnectionHandlerID, PluginCommandTarget_CLIENT, targetIDs, REQUESTGW2INFO_FLAG_KEYFRAME);
+		return true;
+	}
+
+	void queueGW2InfoReply(uint64 serverConnectionHandlerID, anyID clientID, int flags) {
+		// A client that missed an update ignores all deltas until it gets a keyframe, so it's always answered; the requester
+		// limits these requests itself and the coalescing window still merges repeated ones
+		bool keyframeRequested = (flags & REQUESTGW2INFO_FLAG_KEYFRAME) != 0 && peerProtocolVersions.get(serverConnectionHandlerID, clientID) >= PROTOCOL_VERSION_COMPACT;
+		if (!replyRateLimit.tryAcquire(serverConnectionHandlerID, clientID, REQUESTGW2INFO_REPLY_INTERVAL) && !keyframeRequested) {
+			debuglog("GW2Plugin: Already replied to client %d recently\n", clientID);
+			return;
+		}
+		pendingReplies.add(serverConnectionHandlerID, clientID);
+	}
+
+	void sendQueuedGW2InfoReplies(const Gw2Info& gw2Info) {
+		uint64 serverConnectionHandlerID;
+		vector<anyID> clientIDs;
+		while (pendingReplies.takeDue(serverConnectionHandlerID, clientIDs)) {
+			if (clientIDs.size() >= REQUESTGW2INFO_BROADCAST_THRESHOLD) {
+				// Every interested client gets the keyframe, which also serves as the periodic one
+				debuglog("GW2Plugin: Broadcasting reply to %d requests\n", clientIDs.size());
+				transmitGW2Info(serverConnectionHandlerID, gw2Info, PluginCommandTarget_SERVER, NULL, true);
+			} else {
+				clientIDs.push_back(0);
+				transmitGW2Info(serverConnectionHandlerID, gw2Info, PluginCommandTarget_CLIENT, &clientIDs[0], false);
+			}
+			clientIDs.clear();
+		}
+	}
+
+	void subscribe(uint64 serverConnectionHandlerID, anyID clientID) {
+		subscriptions.subscribe(serverConnectionHandlerID, clientID);
+	}
+
+	bool renewSubscription(uint64 serverConnectionHandlerID, anyID clientID) {
+		// Clients in our channel broadcast to us anyway, and legacy peers don't know subscriptions. The channel is checked first,
+		// so a client that leaves our channel is subscribed to right away.
+		if (peerProtocolVersions.get(serverConnectionHandlerID, clientID) < PROTOCOL_VERSION_COMPACT || isInOwnChannel(serverConnectionHandlerID, clientID))
+			return false;
+		if (!subscriptionRenewals.tryAcquire(serverConnectionHandlerID, clientID, GW2INFO_SUBSCRIPTION_RENEW_INTERVAL))
+			return false;
+		debuglog("GW2Plugin: Renewing subscription to client %d\n", clientID);
+		anyID targetIDs[] = { clientID, 0 };
+		requestGW2Info(serverConnectionHandlerID, PluginCommandTarget_CLIENT, targetIDs, 0);
+		return true;
+	}
+
+	void setPeerProtocolVersion(uint64 serverConnectionHandlerID, anyID clientID, int protocolVersion) {
+		peerProtocolVersions.set(serverConnectionHandlerID, clientID, protocolVersion);
+	}
+
+	void removePeer(uint64 serverConnectionHandlerID, anyID clientID) {
+		peerProtocolVersions.remove(serverConnectionHandlerID, clientID);
+		requestRateLimit.remove(serverConnectionHandlerID, clientID);
+		keyframeRequestRateLimit.remove(serverConnectionHandlerID, clientID);
+		subscriptionRenewals.remove(serverConnectionHandlerID, clientID);
+		replyRateLimit.remove(serverConnectionHandlerID, clientID);
+		pendingReplies.remove(serverConnectionHandlerID, clientID);
+		subscriptions.remove(serverConnectionHandlerID, clientID);
+	}
+
+	void removeAllPeers(uint64 serverConnectionHandlerID) {
+		peerProtocolVersions.removeAll(serverConnectionHandlerID);
+		requestRateLimit.removeAll(serverConnectionHandlerID);
+		keyframeRequestRateLimit.removeAll(serverConnectionHandlerID);
+		subscriptionRenewals.removeAll(serverConnectionHandlerID);
+		replyRateLimit.removeAll(serverConnectionHandlerID);
+		pendingReplies.removeAll(serverConnectionHandlerID);
+		subscriptions.removeAll(serverConnectionHandlerID);
+	}
+
+	void resetTransmitState(uint64 serverConnectionHandlerID) {
+		transmitStates.remove(serverConnectionHandlerID);
 	}
 
 }
@@ -14,8 +14,10 @@
 
 #include <stdio.h>
 #include <string>
+#include <vector>
 #include "public_definitions.h"
 #include "gw2info.h"
+#include "stringutils.h"
 
 #if _DEBUG
 #define debuglog(str, ...) printf(str, __VA_ARGS__);
@@ -23,18 +25,79 @@
 #define debuglog(str, ...)
 #endif
 
+/* Protocol versions announced in RequestGW2Info, plugins without an announcement only understand JSON */
+#define PROTOCOL_VERSION_JSON 1
+#define PROTOCOL_VERSION_COMPACT 2
+#define PROTOCOL_VERSION PROTOCOL_VERSION_COMPACT
+
+/* Number of compact deltas broadcast before a full keyframe is broadcast again, which lets receivers recover from missed updates */
+#define GW2INFO_KEYFRAME_INTERVAL 30
+
+/* Maximum number of parameters of a received command; only RequestGW2Info has more than 2 */
+#define COMMAND_MAX_PARAMETERS 3
+
+/* RequestGW2Info rate limits */
+#define REQUESTGW2INFO_REQUEST_INTERVAL 10000	// Minimum time in ms between two requests to the same client
+#define REQUESTGW2INFO_REPLY_INTERVAL 5000		// Minimum time in ms between two replies to the same client
+#define REQUESTGW2INFO_COALESCE_WINDOW 500		// Requests that arrive within this time in ms are answered with one command
+#define REQUESTGW2INFO_BROADCAST_THRESHOLD 8	// Number of requesters from which on the reply is broadcast to all interested clients
+#define REQUESTGW2INFO_KEYFRAME_REQUEST_INTERVAL 2000	// Minimum time in ms between two keyframe requests to the same client
+
+/* RequestGW2Info flags, sent as the optional third parameter */
+#define REQUESTGW2INFO_FLAG_KEYFRAME 1	// The requester missed an update and can't apply any delta before the next keyframe
+
+/* Time in ms that a client keeps receiving our updates after it requested our info */
+#define GW2INFO_SUBSCRIPTION_DURATION (30 * 60 * 1000)
+/* Time in ms after which we renew our own subscription to a viewed client outside our channel, well before it expires */
+#define GW2INFO_SUBSCRIPTION_RENEW_INTERVAL (GW2INFO_SUBSCRIPTION_DURATION / 2)
+
 namespace Commands {
 
 	enum CommandType { 
 		CMD_NONE = 0,
 		CMD_GW2INFO, 
-		CMD_REQUESTGW2INFO
+		CMD_REQUESTGW2INFO,
+		CMD_GW2INFOCOMPACT
+	};
+
+	/* A received command; the parameters reference the original command string, the last one holds its remainder */
+	struct Command {
+		CommandType type;
+		StringRef parameters[COMMAND_MAX_PARAMETERS];
+		size_t parameterCount;
 	};
 
-	bool parseCommand(const std::string& command, CommandType& commandType, std::vector<std::string>& commandParameters);
+	bool parseCommand(const char* command, Command& result);
 
 	void send(uint64 serverConnectionHandlerID, CommandType type, const std::string& parameters, int targetMode, const anyID* targetIDs, const char* returnCode);
-	void requestGW2Info(uint64 serverConnectionHandlerID, int targetMode, const anyID* targetIDs);
+	void requestGW2Info(uint64 serverConnectionHandlerID, int targetMode, const anyID* targetIDs, int flags);
+	/* Requests the info of a single client, unless it has already been requested recently; returns false if the request was skipped */
+	bool requestGW2InfoFromClient(uint64 serverConnectionHandlerID, anyID clientID);
+	/* Requests a keyframe after a missed update, limited separately and answered regardless of the reply limit of the client */
+	bool requestGW2InfoKeyframeFromClient(uint64 serverConnectionHandlerID, anyID clientID);
+	/*
+	 * Sends the compact encoding, and the JSON encoding to peers that are known to use an older protocol version; targetIDs is terminated by 0.
+	 * Any target mode other than PluginCommandTarget_CLIENT is a broadcast, which only goes to the clients in our channel and the subscribers.
+	 * Broadcasts only contain the fields that changed since the previous broadcast, while replies to single clients are always keyframes.
+	 */
 	void sendGW2Info(uint64 serverConnectionHandlerID, const Gw2Info& gw2Info, int targetMode, const anyID* targetIDs);
 
+	/* Lets a client receive our broadcasts for GW2INFO_SUBSCRIPTION_DURATION, even if it's not in our channel */
+	void subscribe(uint64 serverConnectionHandlerID, anyID clientID);
+	/*
+	 * Requests the info of a client outside our channel again if we didn't request it within GW2INFO_SUBSCRIPTION_RENEW_INTERVAL,
+	 * which renews our subscription to its broadcasts; returns false if nothing was sent
+	 */
+	bool renewSubscription(uint64 serverConnectionHandlerID, anyID clientID);
+	/* Queues a reply to a RequestGW2Info, unless the client has already received one recently and didn't ask for a keyframe */
+	void queueGW2InfoReply(uint64 serverConnectionHandlerID, anyID clientID, int flags);
+	/* Sends the queued replies whose coalescing window has passed */
+	void sendQueuedGW2InfoReplies(const Gw2Info& gw2Info);
+
+	void setPeerProtocolVersion(uint64 serverConnectionHandlerID, anyID clientID, int protocolVersion);
+	void removePeer(uint64 serverConnectionHandlerID, anyID clientID);
+	void removeAllPeers(uint64 serverConnectionHandlerID);
+	/* Forgets the last broadcast state, so the next broadcast is a keyframe */
+	void resetTransmitState(uint64 serverConnectionHandlerID);
+
 }
@@ -21,11 +21,18 @@ namespace Globals {
 	int onlineStateTransmissionThreshold = DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD;
 	int distanceTransmissionThreshold = DEFAULTCONFIG_DISTANCETRANSMISSIONTHRESHOLD;
 
+	std::string mumbleLinkRecordFile;
+	std::string mumbleLinkReplayFile;
+	double mumbleLinkReplaySpeed = DEFAULTCONFIG_MUMBLELINKREPLAYSPEED;
+
 	void loadConfig() {
 		QSettings cfg(QString::fromStdString(getConfigFilePath()), QSettings::IniFormat);
 		locationTransmissionThreshold = cfg.value("locationTransmissionThreshold", DEFAULTCONFIG_LOCATIONTRANSMISSIONTHRESHOLD).toInt();
 		onlineStateTransmissionThreshold = cfg.value("onlineStateTransmissionThreshold", DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD).toInt();
 		distanceTransmissionThreshold = cfg.value("distanceTransmissionThreshold", DEFAULTCONFIG_DISTANCETRANSMISSIONTHRESHOLD).toInt();
+		mumbleLinkRecordFile = cfg.value("mumbleLinkRecordFile", "").toString().toStdString();
+		mumbleLinkReplayFile = cfg.value("mumbleLinkReplayFile", "").toString().toStdString();
+		mumbleLinkReplaySpeed = cfg.value("mumbleLinkReplaySpeed", DEFAULTCONFIG_MUMBLELINKREPLAYSPEED).toDouble();
 	}
 
 	std::string getConfigFilePath() {
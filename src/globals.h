@@ -23,6 +23,7 @@
 #define DEFAULTCONFIG_LOCATIONTRANSMISSIONTHRESHOLD 3
 #define DEFAULTCONFIG_ONLINESTATETRANSMISSIONTHRESHOLD 15
 #define DEFAULTCONFIG_DISTANCETRANSMISSIONTHRESHOLD 10
+#define DEFAULTCONFIG_MUMBLELINKREPLAYSPEED 1.0
 
 
 namespace Globals {
@@ -33,6 +34,11 @@ namespace Globals {
 	extern int onlineStateTransmissionThreshold;
 	extern int distanceTransmissionThreshold;
 
+	/* Debugging aids, only configurable through the config file */
+	extern std::string mumbleLinkRecordFile;
+	extern std::string mumbleLinkReplayFile;
+	extern double mumbleLinkReplaySpeed;
+
 	void loadConfig();
 
 	std::string getConfigFilePath();
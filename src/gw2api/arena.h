@@ -0,0 +1,186 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <stddef.h>
+#include <stdlib.h>
+#include <limits>
+#include <new>
+#include <utility>
+
+namespace Gw2Api {
+
+	// Bump allocator for object graphs that are released all at once. Nothing is freed before the arena itself is destroyed,
+	// so it's meant for graphs that are built once and only read afterwards, like parsed API responses.
+	class Arena {
+	private:
+		struct Chunk {
+			Chunk* next;
+			size_t size;
+		};
+
+		static const size_t alignment = 2 * sizeof(void*); // Same as malloc, enough for doubles and pointers
+		static size_t align(size_t size) { return (size + alignment - 1) & ~(alignment - 1); }
+
+		Chunk* chunks;
+		char* current;
+		size_t remaining;
+		size_t chunkSize;
+		size_t allocatedSize;
+		Arena* children;
+		Arena* nextSibling;
+
+		Chunk* allocateChunk(size_t size) {
+			Chunk* chunk = (Chunk*)malloc(align(sizeof(Chunk)) + size);
+			if (chunk == NULL)
+				throw std::bad_alloc();
+			chunk->size = size;
+			return chunk;
+		}
+
+		static char* getChunkData(Chunk* chunk) { return (char*)chunk + align(sizeof(Chunk)); }
+
+		Arena(const Arena&);
+		Arena& operator=(const Arena&);
+
+	public:
+		explicit Arena(size_t chunkSize = 64 * 1024) {
+			chunks = NULL;
+			current = NULL;
+			remaining = 0;
+			this->chunkSize = chunkSize;
+			allocatedSize = 0;
+			children = NULL;
+			nextSibling = NULL;
+		}
+
+		~Arena() {
+			while (children != NULL) {
+				Arena* next = children->nextSibling;
+				delete children;
+				children = next;
+			}
+			while (chunks != NULL) {
+				Chunk* next = chunks->next;
+				free(chunks);
+				chunks = next;
+			}
+		}
+
+		void* allocate(size_t size) {
+			size = align(size > 0 ? size : 1);
+			allocatedSize += size;
+			if (size > remaining) {
+				if (size > chunkSize / 4) {
+					// Large blocks get their own chunk, so the rest of the current chunk isn't wasted
+					Chunk* chunk = allocateChunk(size);
+					if (chunks != NULL) {
+						chunk->next = chunks->next;
+						chunks->next = chunk;
+					} else {
+						chunk->next = NULL;
+						chunks = chunk;
+					}
+					return getChunkData(chunk);
+				}
+				Chunk* chunk = allocateChunk(chunkSize);
+				chunk->next = chunks;
+				chunks = chunk;
+				current = getChunkData(chunk);
+				remaining = chunkSize;
+			}
+			void* block = current;
+			current += size;
+			remaining -= size;
+			return block;
+		}
+
+		// Creates an arena that is released together with this one. Arenas aren't thread-safe, so threads that build parts of the
+		// same graph each allocate from their own child arena. Creating the child itself isn't thread-safe either.
+		Arena* createChild() {
+			Arena* child = new Arena(chunkSize);
+			child->nextSibling = children;
+			children = child;
+			return child;
+		}
+
+		// Total size of all allocations including the child arenas, without the unused rest of the chunks
+		size_t getAllocatedSize() const {
+			size_t size = allocatedSize;
+			for (Arena* child = children; child != NULL; child = child->nextSibling)
+				size += child->getAllocatedSize();
+			return size;
+		}
+	};
+
+
+	// Standard allocator on top of an arena, deallocation does nothing. A default constructed allocator isn't bound to an arena
+	// and uses the heap instead, so objects that are templated on it can still be created outside of an arena.
+	template<class T>
+	class ArenaAllocator {
+	public:
+		typedef T value_type;
+		typedef T* pointer;
+		typedef const T* const_pointer;
+		typedef T& reference;
+		typedef const T& const_reference;
+		typedef size_t size_type;
+		typedef ptrdiff_t difference_type;
+
+		template<class U>
+		struct rebind {
+			typedef ArenaAllocator<U> other;
+		};
+
+		Arena* arena;
+
+		ArenaAllocator() { arena = NULL; }
+		explicit ArenaAllocator(Arena* arena) { this->arena = arena; }
+		template<class U>
+		ArenaAllocator(const ArenaAllocator<U>& other) { arena = other.arena; }
+
+		pointer address(reference value) const { return &value; }
+		const_pointer address(const_reference value) const { return &value; }
+
+		pointer allocate(size_type count, const void* = 0) {
+			if (count > max_size())
+				throw std::bad_alloc();
+			if (arena == NULL)
+				return (pointer)::operator new(count * sizeof(T));
+			return (pointer)arena->allocate(count * sizeof(T));
+		}
+
+		void deallocate(pointer block, size_type) {
+			if (arena == NULL)
+				::operator delete(block);
+		}
+
+		size_type max_size() const { return (std::numeric_limits<size_type>::max)() / sizeof(T); }
+
+		void construct(pointer block, const T& value) { ::new ((void*)block) T(value); }
+		template<class U>
+		void construct(pointer block, U&& value) { ::new ((void*)block) T(std::forward<U>(value)); }
+		void destroy(pointer block) { block->~T(); }
+	};
+
+	template<class T, class U>
+	inline bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) { return lhs.arena == rhs.arena; }
+	template<class T, class U>
+	inline bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) { return lhs.arena != rhs.arena; }
+
+	// Allocator for the part of a graph that is built on another thread
+	template<class T>
+	inline ArenaAllocator<T> makeWorkerAllocator(const ArenaAllocator<T>& allocator) {
+		return allocator.arena != NULL ? ArenaAllocator<T>(allocator.arena->createChild()) : allocator;
+	}
+
+}
@@ -12,6 +12,7 @@
 
 // Slightly modified source from http://en.wikibooks.org/wiki/Algorithm_Implementation/Miscellaneous/Base64#C.2B.2B
 
+#pragma once
 #include <string>
 #include <vector>
 
@@ -55,4 +56,45 @@ namespace Gw2Api {
 		return encodedString;
 	}
 
+	// Returns false if the input is not valid base64
+	inline bool base64Decode(const char* input, size_t length, std::vector<unsigned char>& outputBuffer)
+	{
+		if (length % 4 != 0)
+			return false;
+
+		outputBuffer.clear();
+		outputBuffer.reserve((length / 4) * 3);
+		long temp = 0;
+		size_t padding = 0;
+		for (size_t idx = 0; idx < length; idx++)
+		{
+			char c = input[idx];
+			long value;
+			if (c >= 'A' && c <= 'Z') value = c - 'A';
+			else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+			else if (c >= '0' && c <= '9') value = c - '0' + 52;
+			else if (c == '+') value = 62;
+			else if (c == '/') value = 63;
+			else if (c == padCharacter && idx >= length - 2) { value = 0; padding++; }
+			else return false;
+			if (padding > 0 && c != padCharacter)
+				return false;
+
+			temp = (temp << 6) | value;
+			if (idx % 4 == 3)
+			{
+				outputBuffer.push_back((unsigned char)((temp >> 16) & 0xFF));
+				if (padding < 2) outputBuffer.push_back((unsigned char)((temp >> 8) & 0xFF));
+				if (padding < 1) outputBuffer.push_back((unsigned char)(temp & 0xFF));
+				temp = 0;
+			}
+		}
+		return true;
+	}
+
+	inline bool base64Decode(const std::string& input, std::vector<unsigned char>& outputBuffer)
+	{
+		return base64Decode(input.c_str(), input.length(), outputBuffer);
+	}
+
 }
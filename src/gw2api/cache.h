@@ -12,6 +12,8 @@
 
 #pragma once
 #include <map>
+#include <string>
+#include <Windows.h>
 #include "objects.h"
 #include "requests.h"
 
@@ -19,37 +21,66 @@ namespace Gw2Api {
 	
 	namespace Cache {
 
-		static std::map<std::string, ApiResponseObject*> cacheObjects;
+		typedef std::map<std::string, ApiResponseObject*> CacheObjects;
+
+		// One cache for all threads and translation units (defined in cache.cpp), only accessed while holding the lock. Cached
+		// objects are never replaced, so pointers into the cache stay valid until the object is explicitly removed.
+		extern CacheObjects cacheObjects;
+		extern SRWLOCK cacheLock;
 
 		inline void removeCacheObject(const std::string& url) {
-			std::map<std::string, ApiResponseObject*>::iterator it = cacheObjects.find(url);
+			AcquireSRWLockExclusive(&cacheLock);
+			CacheObjects::iterator it = cacheObjects.find(url);
 			if (it != cacheObjects.end()) {
 				delete it->second;
 				cacheObjects.erase(it);
 			}
+			ReleaseSRWLockExclusive(&cacheLock);
 		}
 
 		inline void clearCache() {
-			for (std::map<std::string, ApiResponseObject*>::iterator it = cacheObjects.begin(); it != cacheObjects.end(); it++) {
+			AcquireSRWLockExclusive(&cacheLock);
+			for (CacheObjects::iterator it = cacheObjects.begin(); it != cacheObjects.end(); it++) {
 				delete it->second;
 			}
 			cacheObjects.clear();
+			ReleaseSRWLockExclusive(&cacheLock);
+		}
+
+		// Takes over a response without copying it. If another thread has cached the same request in the meantime, the
+		// response is deleted and the cached one is returned instead.
+		inline ApiResponseObject* adoptCacheObject(ApiResponseObject* object) {
+			object->isCached = true;
+			std::string url = object->request.getFullUrl();
+			AcquireSRWLockExclusive(&cacheLock);
+			std::pair<CacheObjects::iterator, bool> inserted = cacheObjects.insert(CacheObjects::value_type(url, object));
+			ApiResponseObject* cacheObject = inserted.first->second;
+			ReleaseSRWLockExclusive(&cacheLock);
+			if (!inserted.second)
+				delete object;
+			return cacheObject;
 		}
 
+		// Copies are only handed out while holding the lock, so the previous object can be replaced
 		template<class T>
 		inline void addCacheObject(T* object) {
 			T* obj = new T(*object);
 			ApiResponseObject* cacheObject = obj;
-			T* temp = static_cast<T*>(cacheObject);
 			cacheObject->isCached = true;
 			std::string url = cacheObject->request.getFullUrl();
-			cacheObjects[url] = cacheObject;
+			AcquireSRWLockExclusive(&cacheLock);
+			ApiResponseObject*& slot = cacheObjects[url];
+			ApiResponseObject* previous = slot;
+			slot = cacheObject;
+			ReleaseSRWLockExclusive(&cacheLock);
+			delete previous;
 		}
 
 
+		// The lock has to be held
 		static bool getNewerCachedObject(const std::string& urlA, const std::string& urlB, ApiResponseObject** object) {
-			std::map<std::string, ApiResponseObject*>::iterator itA = cacheObjects.find(urlA);
-			std::map<std::string, ApiResponseObject*>::iterator itB = cacheObjects.find(urlB);
+			CacheObjects::iterator itA = cacheObjects.find(urlA);
+			CacheObjects::iterator itB = cacheObjects.find(urlB);
 			if (itA != cacheObjects.end() && itB != cacheObjects.end()) {
 				if (itA->second->requestTime > itB->second->requestTime) {
 					*object = itA->second;
@@ -70,22 +101,40 @@ namespace Gw2Api {
 
 		template<class T>
 		inline bool getCachedObject(const Requests::ApiRequest& request, T* response) {
-			std::map<std::string, ApiResponseObject*>::iterator it = cacheObjects.find(request.getFullUrl());
+			bool found = false;
+			std::string url = request.getFullUrl();
+			AcquireSRWLockShared(&cacheLock);
+			CacheObjects::iterator it = cacheObjects.find(url);
 			if (it != cacheObjects.end()) {
 				*response = T(*dynamic_cast<T*>(it->second));
-				return true;
+				found = true;
 			}
-			return false;
+			ReleaseSRWLockShared(&cacheLock);
+			return found;
+		}
+
+		// Returns the cached response itself, which stays valid until it's removed from the cache
+		template<class T>
+		inline const T* findCachedObject(const Requests::ApiRequest& request) {
+			const T* result = NULL;
+			std::string url = request.getFullUrl();
+			AcquireSRWLockShared(&cacheLock);
+			CacheObjects::iterator it = cacheObjects.find(url);
+			if (it != cacheObjects.end())
+				result = dynamic_cast<const T*>(it->second);
+			ReleaseSRWLockShared(&cacheLock);
+			return result;
 		}
 
-		template<>
-		inline bool getCachedObject(const Requests::ApiRequest& request, MapEntries* response) {
+		template<class T>
+		inline const T* findNewerCachedObject(const std::string& urlA, const std::string& urlB) {
+			const T* result = NULL;
+			AcquireSRWLockShared(&cacheLock);
 			ApiResponseObject* object = NULL;
-			if (getNewerCachedObject(request.url, request.getFullUrl(), &object)) {
-				*response = MapEntries(*dynamic_cast<MapEntries*>(object));
-				return true;
-			}
-			return false;
+			if (getNewerCachedObject(urlA, urlB, &object))
+				result = dynamic_cast<const T*>(object);
+			ReleaseSRWLockShared(&cacheLock);
+			return result;
 		}
 
 	}
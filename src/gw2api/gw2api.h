@@ -11,47 +11,56 @@
 */
 
 #pragma once
+#include <algorithm>
 #include <string>
+#include <vector>
 #include <Windows.h>
 #include <WinInet.h>
 #include "cache.h"
+#include "parallel.h"
 #include "parsers.h"
 #include "requests.h"
 
 
 namespace Gw2Api {
 
-	static bool getFromHttpUrl(const std::string& url, std::string* result, long unsigned* lastError) {
+	// Reads the whole response into a zero-terminated buffer that may be parsed in-situ
+	static bool getFromHttpUrl(const std::string& url, std::vector<char>* result, long unsigned* lastError) {
 		HINTERNET hSession = InternetOpenA("Guild Wars 2 C++ API Wrapper", 0, NULL, NULL, 0);
 		if (hSession == NULL) {
-			*lastError = GetLastError();
+			if (lastError != NULL)
+				*lastError = GetLastError();
 			return false;
 		}
 
 		HINTERNET hOpenUrl = InternetOpenUrlA(hSession, url.c_str(), NULL, 0, 1, 1);
 		if (hOpenUrl == NULL) {
-			*lastError = GetLastError();
-			InternetCloseHandle(hOpenUrl);
+			if (lastError != NULL)
+				*lastError = GetLastError();
+			InternetCloseHandle(hSession);
 			return false;
 		}
 
-		char* buffer = new char[1025];
-		DWORD bytesRead = 0;
+		const size_t chunkSize = 4096;
+		size_t size = 0;
 		while (true) {
-			if (InternetReadFile(hOpenUrl, buffer, 1024, &bytesRead)) {
+			// Read straight into the result instead of going through an intermediate buffer
+			result->resize(size + chunkSize + 1);
+			DWORD bytesRead = 0;
+			if (InternetReadFile(hOpenUrl, &(*result)[size], chunkSize, &bytesRead)) {
 				if (bytesRead == 0)
 					break;
-				buffer[bytesRead] = 0;
-				*result += buffer;
+				size += bytesRead;
 			} else {
-				*lastError = GetLastError();
-				delete[] buffer;
+				if (lastError != NULL)
+					*lastError = GetLastError();
 				InternetCloseHandle(hOpenUrl);
 				InternetCloseHandle(hSession);
 				return false;
 			}
 		}
-		delete[] buffer;
+		result->resize(size + 1);
+		(*result)[size] = 0;
 
 		InternetCloseHandle(hOpenUrl);
 		InternetCloseHandle(hSession);
@@ -61,10 +70,10 @@ namespace Gw2Api {
 	template<class T>
 	static bool handleRequest(const Requests::ApiRequest& request, const Parsers::ApiResponseParser<T>& parser, bool ignoreCache, T* response) {
 		if (ignoreCache || !Cache::getCachedObject(request, response)) {
-			std::string result;
+			std::vector<char> result;
 			std::string url = request.getFullUrl();
 			if (getFromHttpUrl(url, &result, NULL)) {
-				if (parser.parse(result, response)) {
+				if (parser.parseInsitu(&result[0], response)) {
 					response->request = request;
 					response->requestTime = time(NULL);
 					Cache::addCacheObject(response);
@@ -82,31 +91,201 @@ namespace Gw2Api {
 	}
 
 
-	inline bool getMapFloor(const int continent_id, const int floor, MapFloorRootEntry* mapFloorGlobalEntry) { 
+	// Like handleRequest, but the response is kept in the cache and returned without copying it. The response is only valid
+	// until it's removed from the cache.
+	template<class T>
+	static const T* handleCachedRequest(const Requests::ApiRequest& request, const Parsers::ApiResponseParser<T>& parser) {
+		const T* cached = Cache::findCachedObject<T>(request);
+		if (cached != NULL)
+			return cached;
+
+		std::vector<char> result;
+		if (!getFromHttpUrl(request.getFullUrl(), &result, NULL))
+			return NULL;
+		T* response = new T();
+		if (!parser.parseInsitu(&result[0], response)) {
+			delete response;
+			return NULL;
+		}
+		response->request = request;
+		response->requestTime = time(NULL);
+		return dynamic_cast<const T*>(Cache::adoptCacheObject(response));
+	}
+
+
+	inline const ArenaMapFloorRootEntry* getCachedMapFloor(const int continent_id, const int floor) {
 		Requests::MapFloorRequest request = Requests::MapFloorRequest(continent_id, floor);
-		Parsers::MapFloorRootParser parser;
-		return handleRequest(request, parser, false, mapFloorGlobalEntry);
+		// Map floors are only requested on cache misses after map changes, parse them as fast as possible
+		Parsers::ArenaMapFloorRootParser parser = Parsers::ArenaMapFloorRootParser(Parsers::BasicMapFloorRootParser<ResponseArenaAllocator>(true));
+		return handleCachedRequest(request, parser);
 	}
 
-	inline bool getMap(const int map_id, ApiInnerResponseObject<MapsRootEntry, MapEntry>* mapEntry) {
-		Requests::MapsRequest request = Requests::MapsRequest(map_id);
-		Parsers::MapsRootParser parser;
-		if (handleRequest(request, parser, false, &mapEntry->root)) {
-			MapEntries::iterator it = mapEntry->root.maps.find(map_id);
-			if (it != mapEntry->root.maps.end()) {
-				mapEntry->value = it->second;
-				return true;
-			} else {
-				return false;
+	// Number of map floors that are requested at the same time by default
+	const unsigned defaultMaxParallelRequests = 4;
+
+	namespace Internal {
+		// Fetches and parses the map floors that aren't cached yet, without touching the cache
+		struct MapFloorFetchTask {
+			int continent_id;
+			const int* floors;
+			ArenaMapFloorRootEntry** responses;
+			bool parallelRegions; // Only when a single floor is fetched, otherwise the floors themselves are already parsed in parallel
+
+			void operator()(size_t index, unsigned) {
+				// Runs on the thread pool, so nothing may throw out of here
+				try {
+					Requests::MapFloorRequest request = Requests::MapFloorRequest(continent_id, floors[index]);
+					std::vector<char> result;
+					if (!getFromHttpUrl(request.getFullUrl(), &result, NULL))
+						return;
+					ArenaMapFloorRootEntry* response = new ArenaMapFloorRootEntry();
+					Parsers::ArenaMapFloorRootParser parser = Parsers::ArenaMapFloorRootParser(Parsers::BasicMapFloorRootParser<ResponseArenaAllocator>(parallelRegions));
+					if (parser.parseInsitu(&result[0], response)) {
+						response->request = request;
+						response->requestTime = time(NULL);
+						responses[index] = response;
+					} else {
+						delete response;
+					}
+				} catch (const std::bad_alloc&) { }
+			}
+		};
+	}
+
+	/*
+	 * Returns the cached map floors of a continent, the floors that aren't cached yet are requested concurrently, at most
+	 * maxParallelRequests at a time. The result has the same order as the floors, floors that failed to load are NULL.
+	 * Like getCachedMapFloor, the floors are only valid until they're removed from the cache.
+	 */
+	inline void getCachedMapFloors(const int continent_id, const int* floors, size_t count, std::vector<const ArenaMapFloorRootEntry*>* result,
+		unsigned maxParallelRequests = defaultMaxParallelRequests) {
+		result->assign(count, NULL);
+		std::vector<int> missingFloors;
+		std::vector<size_t> missingIndices;
+		for (size_t i = 0; i < count; i++) {
+			(*result)[i] = Cache::findCachedObject<ArenaMapFloorRootEntry>(Requests::MapFloorRequest(continent_id, floors[i]));
+			if ((*result)[i] == NULL) {
+				missingFloors.push_back(floors[i]);
+				missingIndices.push_back(i);
 			}
 		}
-		return false;
+		if (missingFloors.empty())
+			return;
+
+		std::vector<ArenaMapFloorRootEntry*> responses(missingFloors.size(), (ArenaMapFloorRootEntry*)NULL);
+		Internal::MapFloorFetchTask task;
+		task.continent_id = continent_id;
+		task.floors = &missingFloors[0];
+		task.responses = &responses[0];
+		task.parallelRegions = missingFloors.size() == 1;
+		unsigned workers = maxParallelRequests > 0 ? maxParallelRequests : 1;
+		if (workers > missingFloors.size())
+			workers = (unsigned)missingFloors.size();
+		Parallel::parallelFor(missingFloors.size(), workers, task);
+
+		for (size_t i = 0; i < responses.size(); i++) {
+			if (responses[i] != NULL)
+				(*result)[missingIndices[i]] = dynamic_cast<const ArenaMapFloorRootEntry*>(Cache::adoptCacheObject(responses[i]));
+		}
 	}
 
-	inline bool getMaps(MapsRootEntry* mapsRootEntry) {
+	inline const ArenaMapsRootEntry* getCachedMaps() {
 		Requests::MapsRequest request;
-		Parsers::MapsRootParser parser;
-		return handleRequest(request, parser, false, mapsRootEntry);
+		Parsers::ArenaMapsRootParser parser;
+		return handleCachedRequest(request, parser);
+	}
+
+	// Returns the cached map, either from an earlier request of all maps or of this single map
+	inline const BasicMapEntry<ResponseArenaAllocator>* getCachedMap(const int map_id) {
+		Requests::MapsRequest request = Requests::MapsRequest(map_id);
+		const ArenaMapsRootEntry* maps = Cache::findNewerCachedObject<ArenaMapsRootEntry>(request.url, request.getFullUrl());
+		if (maps == NULL || maps->value->maps.find(map_id) == maps->value->maps.end()) {
+			Parsers::ArenaMapsRootParser parser;
+			maps = handleCachedRequest(request, parser);
+			if (maps == NULL)
+				return NULL;
+		}
+		EntryDictionary<int, BasicMapEntry<ResponseArenaAllocator>, ResponseArenaAllocator>::const_iterator it = maps->value->maps.find(map_id);
+		return it != maps->value->maps.end() ? &it->second : NULL;
+	}
+
+	inline bool getMapFloor(const int continent_id, const int floor, MapFloorRootEntry* mapFloorGlobalEntry) { 
+		const ArenaMapFloorRootEntry* cached = getCachedMapFloor(continent_id, floor);
+		if (cached == NULL)
+			return false;
+		*mapFloorGlobalEntry = MapFloorRootEntry(*cached->value);
+		mapFloorGlobalEntry->request = cached->request;
+		mapFloorGlobalEntry->requestTime = cached->requestTime;
+		mapFloorGlobalEntry->isCached = true;
+		return true;
+	}
+
+	// Only the map itself is copied, the root just carries the request
+	inline bool getMap(const int map_id, ApiInnerResponseObject<MapsRootEntry, MapEntry>* mapEntry) {
+		const BasicMapEntry<ResponseArenaAllocator>* cached = getCachedMap(map_id);
+		if (cached == NULL)
+			return false;
+		mapEntry->root.request = Requests::MapsRequest(map_id);
+		mapEntry->root.requestTime = time(NULL);
+		mapEntry->root.isCached = true;
+		mapEntry->value = MapEntry(*cached);
+		return true;
+	}
+
+	inline bool getMaps(MapsRootEntry* mapsRootEntry) {
+		const ArenaMapsRootEntry* cached = getCachedMaps();
+		if (cached == NULL)
+			return false;
+		*mapsRootEntry = MapsRootEntry(*cached->value);
+		mapsRootEntry->request = cached->request;
+		mapsRootEntry->requestTime = cached->requestTime;
+		mapsRootEntry->isCached = true;
+		return true;
+	}
+
+	/*
+	 * Requests the entries of a list of ids from a v2 endpoint, split into requests of at most maxIdsPerRequest ids. All parts
+	 * are parsed into the same response, duplicate ids are only requested once. Ids that the API doesn't know are left out;
+	 * false is returned if any part failed, the response still contains the parts that succeeded. Not cached, since the lists
+	 * differ from call to call.
+	 */
+	template<class T>
+	static bool handleIdsRequest(Requests::IdsRequest& request, const std::vector<int>& ids, const Parsers::ApiResponseParser<T>& parser, T* response) {
+		std::vector<int> uniqueIds = ids;
+		std::sort(uniqueIds.begin(), uniqueIds.end());
+		uniqueIds.erase(std::unique(uniqueIds.begin(), uniqueIds.end()), uniqueIds.end());
+
+		bool success = true;
+		for (size_t i = 0; i < uniqueIds.size(); i += Requests::maxIdsPerRequest) {
+			request.setIDs(&uniqueIds[i], (std::min)(Requests::maxIdsPerRequest, uniqueIds.size() - i));
+			std::vector<char> result;
+			if (!getFromHttpUrl(request.getFullUrl(), &result, NULL) || !parser.parseInsitu(&result[0], response))
+				success = false;
+		}
+		request.setIDs(uniqueIds);
+		response->request = request;
+		response->requestTime = time(NULL);
+		response->isCached = false;
+		return success;
+	}
+
+	inline bool getMapsByIDs(const std::vector<int>& map_ids, MapsRootEntry* mapsRootEntry) {
+		Requests::MapsV2Request request;
+		Parsers::MapsV2RootParser parser;
+		return handleIdsRequest(request, map_ids, parser, mapsRootEntry);
+	}
+
+	inline bool getWorldsByIDs(const std::vector<int>& world_ids, WorldNamesRootEntry* worldNamesRootEntry) {
+		Requests::WorldsRequest request;
+		Parsers::WorldsRootParser parser;
+		return handleIdsRequest(request, world_ids, parser, worldNamesRootEntry);
+	}
+
+	inline bool getContinentMapsByIDs(const int continent_id, const int floor, const int region_id, const std::vector<int>& map_ids,
+		ContinentMapsRootEntry* continentMapsRootEntry) {
+		Requests::ContinentMapsRequest request = Requests::ContinentMapsRequest(continent_id, floor, region_id);
+		Parsers::ContinentMapsRootParser parser;
+		return handleIdsRequest(request, map_ids, parser, continentMapsRootEntry);
 	}
 
 	inline bool getWorldNames(WorldNamesRootEntry* worldNamesRootEntry) {
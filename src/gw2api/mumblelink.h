@@ -13,12 +13,13 @@
 #pragma once
 #include <codecvt>
 #include <locale>
+#include <stdarg.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <string>
-#include <Windows.h>
 #include "rapidjson/document.h"
 #include "math.h"
-#include "parsers.h"
 
 namespace Gw2Api {
 
@@ -44,6 +45,8 @@ namespace Gw2Api {
 		static uint32_t lastTick;
 		static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
 
+		static const wchar_t gw2GameName[] = L"Guild Wars 2";
+
 		enum Profession {
 			Guardian = 1,
 			Warrior,
@@ -98,7 +101,7 @@ namespace Gw2Api {
 		};
 
 		struct MumbleContext {
-			byte serverAddress[28]; // contains sockaddr_in or sockaddr_in6
+			unsigned char serverAddress[28]; // contains sockaddr_in or sockaddr_in6
 			unsigned mapId;
 			unsigned mapType;
 			unsigned shardId;
@@ -106,27 +109,140 @@ namespace Gw2Api {
 			unsigned buildId;
 		};
 
-		inline bool initLink() {
-			lm = NULL;
-			lastTick = 0;
+		enum MapType {
+			Redirect = 0,
+			CharacterCreate,
+			PvP,
+			GvG,
+			Instance,
+			Public,
+			Tournament,
+			Tutorial,
+			UserTournament,
+			EternalBattlegrounds,
+			BlueBorderlands,
+			GreenBorderlands,
+			RedBorderlands,
+			FortunesVale,
+			ObsidianSanctum,
+			EdgeOfTheMists
+		};
+
+		// Address families as written by the game client, which always uses the Windows values
+		const uint16_t serverAddressFamilyIPv4 = 2;
+		const uint16_t serverAddressFamilyIPv6 = 23;
+
+		struct ServerAddress {
+			uint16_t family; // 0 if unknown
+			unsigned char address[16]; // 4 bytes for IPv4, 16 bytes for IPv6
+			uint16_t port;
+
+			ServerAddress() {
+				family = 0;
+				memset(address, 0, sizeof(address));
+				port = 0;
+			}
+
+			// Bounded formatting that also compiles outside of MSVC, which has no snprintf and warns about sprintf
+			static int format(char* buffer, size_t size, const char* formatString, ...) {
+				va_list args;
+				va_start(args, formatString);
+#ifdef _WIN32
+				int length = _vsnprintf_s(buffer, size, _TRUNCATE, formatString, args);
+#else
+				int length = vsnprintf(buffer, size, formatString, args);
+#endif
+				va_end(args);
+				return length > 0 ? length : 0;
+			}
+
+			std::string toString() const {
+				char buffer[64]; // Large enough for the longest IPv6 address with port
+				if (family == serverAddressFamilyIPv4) {
+					format(buffer, sizeof(buffer), "%u.%u.%u.%u:%u", address[0], address[1], address[2], address[3], port);
+				} else if (family == serverAddressFamilyIPv6) {
+					size_t pos = 0;
+					buffer[pos++] = '[';
+					for (size_t i = 0; i < 16; i += 2) {
+						pos += format(buffer + pos, sizeof(buffer) - pos, i > 0 ? ":%x" : "%x", (address[i] << 8) | address[i + 1]);
+					}
+					format(buffer + pos, sizeof(buffer) - pos, "]:%u", port);
+				} else {
+					return "";
+				}
+				return buffer;
+			}
+
+			friend bool operator==(const ServerAddress& lhs, const ServerAddress& rhs) {
+				return lhs.family == rhs.family && lhs.port == rhs.port && memcmp(lhs.address, rhs.address, sizeof(lhs.address)) == 0;
+			}
+
+			friend bool operator!=(const ServerAddress& lhs, const ServerAddress& rhs) {
+				return !(lhs == rhs);
+			}
+		};
 
-			HANDLE hMapObject = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(LinkedMem), L"MumbleLink");
-			if (hMapObject == NULL) {
-				return false;
+		// Parsed copy of MumbleContext, so it can be compared with a previous state
+		struct MumbleContextSnapshot {
+			ServerAddress serverAddress;
+			uint32_t mapId;
+			MapType mapType;
+			uint32_t shardId;
+			uint32_t instance;
+			uint32_t buildId;
+
+			MumbleContextSnapshot() {
+				mapId = 0;
+				mapType = Redirect;
+				shardId = 0;
+				instance = 0;
+				buildId = 0;
 			}
 
-			lm = (LinkedMem*)MapViewOfFile(hMapObject, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(LinkedMem));
-			if (lm == NULL) {
-				CloseHandle(hMapObject);
-				hMapObject = NULL;
-				return false;
+			friend bool operator==(const MumbleContextSnapshot& lhs, const MumbleContextSnapshot& rhs) {
+				return lhs.serverAddress == rhs.serverAddress && lhs.mapId == rhs.mapId && lhs.mapType == rhs.mapType
+					&& lhs.shardId == rhs.shardId && lhs.instance == rhs.instance && lhs.buildId == rhs.buildId;
 			}
 
-			return true;
+			friend bool operator!=(const MumbleContextSnapshot& lhs, const MumbleContextSnapshot& rhs) {
+				return !(lhs == rhs);
+			}
+		};
+
+		enum ContextChange {
+			ContextUnchanged = 0,
+			ServerAddressChanged = 1 << 0,
+			MapChanged = 1 << 1,
+			MapTypeChanged = 1 << 2,
+			ShardChanged = 1 << 3,
+			InstanceChanged = 1 << 4,
+			BuildChanged = 1 << 5
+		};
+
+		// Returns a combination of ContextChange flags
+		inline int getContextChanges(const MumbleContextSnapshot& prev, const MumbleContextSnapshot& next) {
+			int changes = ContextUnchanged;
+			if (prev.serverAddress != next.serverAddress) changes |= ServerAddressChanged;
+			if (prev.mapId != next.mapId) changes |= MapChanged;
+			if (prev.mapType != next.mapType) changes |= MapTypeChanged;
+			if (prev.shardId != next.shardId) changes |= ShardChanged;
+			if (prev.instance != next.instance) changes |= InstanceChanged;
+			if (prev.buildId != next.buildId) changes |= BuildChanged;
+			return changes;
+		}
+
+		// Points the link to the buffer of a link source (see mumblelinksource.h), NULL detaches it
+		inline void attachLink(LinkedMem* mem) {
+			lm = mem;
+			lastTick = 0;
+		}
+
+		inline const LinkedMem* getLinkedMem() {
+			return lm;
 		}
 
 		inline bool isActive() {
-			if (lm->uiTick > lastTick) {
+			if (lm != NULL && lm->uiTick > lastTick) {
 				lastTick = lm->uiTick;
 				return true;
 			}
@@ -137,23 +253,24 @@ namespace Gw2Api {
 			return converter.to_bytes(lm->name);
 		}
 
+		// Compares the name in place, without converting it to UTF-8 first like getGame does
 		inline bool isGW2() {
-			return getGame() == "Guild Wars 2";
+			return lm != NULL && memcmp(lm->name, gw2GameName, sizeof(gw2GameName)) == 0;
 		}
 
 		inline MumbleIdentity getIdentity() {
 			MumbleIdentity mumbleIdentity;
 
 			std::string identity = converter.to_bytes(lm->identity);
-			Parsers::RJDoc json;
+			rapidjson::Document json;
 			json.Parse<0>(identity.c_str());
 
-			const Parsers::RJValue& rj_name = json["name"];
-			const Parsers::RJValue& rj_profession = json["profession"];
-			const Parsers::RJValue& rj_map_id = json["map_id"];
-			const Parsers::RJValue& rj_world_id = json["world_id"];
-			const Parsers::RJValue& rj_team_color_id = json["team_color_id"];
-			const Parsers::RJValue& rj_commander = json["commander"];
+			const rapidjson::Value& rj_name = json["name"];
+			const rapidjson::Value& rj_profession = json["profession"];
+			const rapidjson::Value& rj_map_id = json["map_id"];
+			const rapidjson::Value& rj_world_id = json["world_id"];
+			const rapidjson::Value& rj_team_color_id = json["team_color_id"];
+			const rapidjson::Value& rj_commander = json["commander"];
 
 			if (!rj_name.IsNull() && rj_name.IsString())				mumbleIdentity.name = rj_name.GetString();
 			if (!rj_profession.IsNull() && rj_profession.IsInt())		mumbleIdentity.profession = (Profession)rj_profession.GetInt();
@@ -172,6 +289,34 @@ namespace Gw2Api {
 		inline MumbleContext* getContext() {
 			return (MumbleContext*)lm->context;
 		}
+
+		inline MumbleContextSnapshot getContextSnapshot() {
+			MumbleContextSnapshot snapshot;
+			if (lm == NULL || lm->context_len < sizeof(MumbleContext))
+				return snapshot;
+
+			MumbleContext context;
+			memcpy(&context, lm->context, sizeof(MumbleContext));
+			snapshot.mapId = context.mapId;
+			snapshot.mapType = (MapType)context.mapType;
+			snapshot.shardId = context.shardId;
+			snapshot.instance = context.instance;
+			snapshot.buildId = context.buildId;
+
+			// sockaddr_in(6) layout: family (host order), port (network order), IPv4 address or IPv6 flow info + address
+			const unsigned char* sa = context.serverAddress;
+			uint16_t family = (uint16_t)(sa[0] | (sa[1] << 8));
+			if (family == serverAddressFamilyIPv4) {
+				snapshot.serverAddress.family = family;
+				snapshot.serverAddress.port = (uint16_t)((sa[2] << 8) | sa[3]);
+				memcpy(snapshot.serverAddress.address, sa + 4, 4);
+			} else if (family == serverAddressFamilyIPv6) {
+				snapshot.serverAddress.family = family;
+				snapshot.serverAddress.port = (uint16_t)((sa[2] << 8) | sa[3]);
+				memcpy(snapshot.serverAddress.address, sa + 8, 16);
+			}
+			return snapshot;
+		}
 	}
 
 }
\ No newline at end of file
@@ -0,0 +1,164 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <stdio.h>
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "mumblelink.h"
+
+namespace Gw2Api {
+
+	namespace MumbleLink {
+
+		// Provides the LinkedMem buffer that the MumbleLink functions read from
+		class LinkSource {
+		public:
+			virtual ~LinkSource() { }
+
+			virtual bool open() = 0;
+			virtual void close() = 0;
+			virtual bool isOpen() const = 0;
+			virtual LinkedMem* getLinkedMem() = 0;
+
+			// Called once per poll before the link is read, sources that produce their own data (e.g. replays) advance here
+			virtual void update() { }
+		};
+
+#ifdef _WIN32
+		// Shared memory as used by Mumble on Windows: a named file mapping called "MumbleLink"
+		class WindowsLinkSource : public LinkSource {
+		private:
+			HANDLE hMapObject;
+			LinkedMem* mem;
+
+		public:
+			WindowsLinkSource() {
+				hMapObject = NULL;
+				mem = NULL;
+			}
+
+			~WindowsLinkSource() { close(); }
+
+			bool open() {
+				close();
+				hMapObject = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(LinkedMem), L"MumbleLink");
+				if (hMapObject == NULL) {
+					return false;
+				}
+
+				mem = (LinkedMem*)MapViewOfFile(hMapObject, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(LinkedMem));
+				if (mem == NULL) {
+					CloseHandle(hMapObject);
+					hMapObject = NULL;
+					return false;
+				}
+
+				return true;
+			}
+
+			void close() {
+				if (mem != NULL) {
+					UnmapViewOfFile(mem);
+					mem = NULL;
+				}
+				if (hMapObject != NULL) {
+					CloseHandle(hMapObject);
+					hMapObject = NULL;
+				}
+			}
+
+			bool isOpen() const { return mem != NULL; }
+			LinkedMem* getLinkedMem() { return mem; }
+		};
+#else
+		// Shared memory as used by Mumble on POSIX systems: /dev/shm/MumbleLink.<uid>
+		class PosixLinkSource : public LinkSource {
+		private:
+			int fd;
+			LinkedMem* mem;
+
+		public:
+			PosixLinkSource() {
+				fd = -1;
+				mem = NULL;
+			}
+
+			~PosixLinkSource() { close(); }
+
+			static std::string getName() {
+				char name[32];
+				snprintf(name, sizeof(name), "/MumbleLink.%u", (unsigned)getuid());
+				return name;
+			}
+
+			bool open() {
+				close();
+				fd = shm_open(getName().c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+				if (fd < 0) {
+					return false;
+				}
+
+				// Whoever opens the link first creates it, so make sure it's large enough to hold a LinkedMem
+				struct stat st;
+				if (fstat(fd, &st) != 0 || ((size_t)st.st_size < sizeof(LinkedMem) && ftruncate(fd, sizeof(LinkedMem)) != 0)) {
+					::close(fd);
+					fd = -1;
+					return false;
+				}
+
+				void* map = mmap(NULL, sizeof(LinkedMem), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				if (map == MAP_FAILED) {
+					::close(fd);
+					fd = -1;
+					return false;
+				}
+
+				mem = (LinkedMem*)map;
+				return true;
+			}
+
+			void close() {
+				if (mem != NULL) {
+					munmap(mem, sizeof(LinkedMem));
+					mem = NULL;
+				}
+				if (fd >= 0) {
+					::close(fd);
+					fd = -1;
+				}
+			}
+
+			bool isOpen() const { return mem != NULL; }
+			LinkedMem* getLinkedMem() { return mem; }
+		};
+#endif
+
+		// Creates the shared memory link source of the current platform, the caller owns the returned object
+		inline LinkSource* createSharedMemoryLinkSource() {
+#ifdef _WIN32
+			return new WindowsLinkSource();
+#else
+			return new PosixLinkSource();
+#endif
+		}
+
+	}
+
+}
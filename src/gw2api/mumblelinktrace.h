@@ -0,0 +1,347 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#endif
+#include "mumblelink.h"
+#include "mumblelinksource.h"
+
+namespace Gw2Api {
+
+	namespace MumbleLink {
+
+		/*
+		 * Trace file layout (little-endian):
+		 *   header: char[8] magic, uint32 version, uint32 image size
+		 *   frame:  uint32 timestamp in ms since the start of the recording, uint16 span count,
+		 *           followed by span count times (uint16 offset, uint16 length, byte[length])
+		 * Every frame only contains the byte spans of the image that changed since the previous frame.
+		 */
+
+		const char traceMagic[8] = { 'G', 'W', '2', 'M', 'L', 'T', 'R', 0 };
+		const uint32_t traceVersion = 1;
+		const size_t traceSpanMergeGap = 8; // Unchanged gaps smaller than this are merged into one span to save span headers
+
+		// Platform independent image of LinkedMem that is used in trace files, strings are always stored as UTF-16
+		// (characters outside of the BMP are truncated on platforms where wchar_t is 32-bit, but Guild Wars 2 doesn't use them)
+		struct LinkedMemImage {
+			uint32_t uiVersion;
+			uint32_t uiTick;
+			float	fAvatarPosition[3];
+			float	fAvatarFront[3];
+			float	fAvatarTop[3];
+			uint16_t name[256];
+			float	fCameraPosition[3];
+			float	fCameraFront[3];
+			float	fCameraTop[3];
+			uint16_t identity[256];
+			uint32_t context_len;
+			unsigned char context[256];
+			uint16_t description[2048];
+		};
+
+		inline uint32_t getTraceClock() {
+#ifdef _WIN32
+			return GetTickCount();
+#else
+			timespec ts;
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+#endif
+		}
+
+		inline void toLinkedMemImage(const LinkedMem* mem, LinkedMemImage* image) {
+			image->uiVersion = mem->uiVersion;
+			image->uiTick = mem->uiTick;
+			memcpy(image->fAvatarPosition, mem->fAvatarPosition, sizeof(image->fAvatarPosition));
+			memcpy(image->fAvatarFront, mem->fAvatarFront, sizeof(image->fAvatarFront));
+			memcpy(image->fAvatarTop, mem->fAvatarTop, sizeof(image->fAvatarTop));
+			for (size_t i = 0; i < 256; i++) image->name[i] = (uint16_t)mem->name[i];
+			memcpy(image->fCameraPosition, mem->fCameraPosition, sizeof(image->fCameraPosition));
+			memcpy(image->fCameraFront, mem->fCameraFront, sizeof(image->fCameraFront));
+			memcpy(image->fCameraTop, mem->fCameraTop, sizeof(image->fCameraTop));
+			for (size_t i = 0; i < 256; i++) image->identity[i] = (uint16_t)mem->identity[i];
+			image->context_len = mem->context_len;
+			memcpy(image->context, mem->context, sizeof(image->context));
+			for (size_t i = 0; i < 2048; i++) image->description[i] = (uint16_t)mem->description[i];
+		}
+
+		inline void fromLinkedMemImage(const LinkedMemImage* image, LinkedMem* mem) {
+			mem->uiVersion = image->uiVersion;
+			mem->uiTick = image->uiTick;
+			memcpy(mem->fAvatarPosition, image->fAvatarPosition, sizeof(mem->fAvatarPosition));
+			memcpy(mem->fAvatarFront, image->fAvatarFront, sizeof(mem->fAvatarFront));
+			memcpy(mem->fAvatarTop, image->fAvatarTop, sizeof(mem->fAvatarTop));
+			for (size_t i = 0; i < 256; i++) mem->name[i] = (wchar_t)image->name[i];
+			memcpy(mem->fCameraPosition, image->fCameraPosition, sizeof(mem->fCameraPosition));
+			memcpy(mem->fCameraFront, image->fCameraFront, sizeof(mem->fCameraFront));
+			memcpy(mem->fCameraTop, image->fCameraTop, sizeof(mem->fCameraTop));
+			for (size_t i = 0; i < 256; i++) mem->identity[i] = (wchar_t)image->identity[i];
+			mem->context_len = image->context_len;
+			memcpy(mem->context, image->context, sizeof(mem->context));
+			for (size_t i = 0; i < 2048; i++) mem->description[i] = (wchar_t)image->description[i];
+		}
+
+
+		// Writes every new Mumble Link tick to a trace file
+		class TraceRecorder {
+		private:
+			FILE* file;
+			uint32_t startTime;
+			uint32_t lastTick;
+			bool hasFrame;
+			LinkedMemImage prevImage;
+			LinkedMemImage image;
+
+			void writeFrame(uint32_t timestamp) {
+				const unsigned char* prevBytes = (const unsigned char*)&prevImage;
+				const unsigned char* bytes = (const unsigned char*)&image;
+				const size_t size = sizeof(LinkedMemImage);
+
+				// Collect the changed spans first, because the span count precedes them
+				uint16_t spans[2 * (sizeof(LinkedMemImage) / (traceSpanMergeGap + 1) + 1)];
+				uint16_t spanCount = 0;
+				size_t i = 0;
+				while (i < size) {
+					if (hasFrame && bytes[i] == prevBytes[i]) {
+						i++;
+						continue;
+					}
+					size_t start = i;
+					size_t end = i + 1;
+					size_t gap = 0;
+					for (i = end; i < size && gap < traceSpanMergeGap; i++) {
+						if (!hasFrame || bytes[i] != prevBytes[i]) {
+							end = i + 1;
+							gap = 0;
+						} else {
+							gap++;
+						}
+					}
+					i = end;
+					spans[spanCount * 2] = (uint16_t)start;
+					spans[spanCount * 2 + 1] = (uint16_t)(end - start);
+					spanCount++;
+				}
+
+				fwrite(&timestamp, sizeof(timestamp), 1, file);
+				fwrite(&spanCount, sizeof(spanCount), 1, file);
+				for (uint16_t s = 0; s < spanCount; s++) {
+					fwrite(&spans[s * 2], sizeof(uint16_t), 2, file);
+					fwrite(bytes + spans[s * 2], 1, spans[s * 2 + 1], file);
+				}
+			}
+
+		public:
+			TraceRecorder() {
+				file = NULL;
+				startTime = 0;
+				lastTick = 0;
+				hasFrame = false;
+			}
+
+			~TraceRecorder() { close(); }
+
+			bool open(const std::string& path) {
+				close();
+				file = fopen(path.c_str(), "wb");
+				if (file == NULL)
+					return false;
+
+				uint32_t imageSize = sizeof(LinkedMemImage);
+				fwrite(traceMagic, sizeof(traceMagic), 1, file);
+				fwrite(&traceVersion, sizeof(traceVersion), 1, file);
+				fwrite(&imageSize, sizeof(imageSize), 1, file);
+				startTime = getTraceClock();
+				lastTick = 0;
+				hasFrame = false;
+				return true;
+			}
+
+			void close() {
+				if (file != NULL) {
+					fclose(file);
+					file = NULL;
+				}
+			}
+
+			bool isOpen() const { return file != NULL; }
+
+			// Records the current state of the link if its tick has changed since the last recorded frame
+			bool record(const LinkedMem* mem) {
+				if (file == NULL || mem == NULL || (hasFrame && mem->uiTick == lastTick))
+					return false;
+
+				toLinkedMemImage(mem, &image);
+				writeFrame(getTraceClock() - startTime);
+				prevImage = image;
+				lastTick = mem->uiTick;
+				hasFrame = true;
+				return true;
+			}
+		};
+
+
+		// Reads a trace file back into a LinkedMem buffer
+		class TraceReplayer {
+		private:
+			FILE* file;
+			long dataStart;
+			double speed;
+			uint32_t startTime;
+			bool hasPending;
+			uint32_t pendingTimestamp;
+			bool finished;
+			LinkedMemImage image;
+			LinkedMem mem;
+
+			bool applyPendingFrame() {
+				uint16_t spanCount;
+				if (fread(&spanCount, sizeof(spanCount), 1, file) != 1)
+					return false;
+
+				unsigned char* bytes = (unsigned char*)&image;
+				for (uint16_t s = 0; s < spanCount; s++) {
+					uint16_t span[2];
+					if (fread(span, sizeof(uint16_t), 2, file) != 2 || (size_t)span[0] + span[1] > sizeof(LinkedMemImage))
+						return false;
+					if (fread(bytes + span[0], 1, span[1], file) != span[1])
+						return false;
+				}
+				return true;
+			}
+
+		public:
+			TraceReplayer() {
+				file = NULL;
+				dataStart = 0;
+				speed = 1;
+				startTime = 0;
+				hasPending = false;
+				pendingTimestamp = 0;
+				finished = false;
+				memset(&image, 0, sizeof(image));
+				memset(&mem, 0, sizeof(mem));
+			}
+
+			~TraceReplayer() { close(); }
+
+			// A speed of 1 replays in real time, higher values replay accelerated and a speed of 0 or lower
+			// applies exactly one frame per update regardless of the recorded timestamps
+			bool open(const std::string& path, double speed) {
+				close();
+				file = fopen(path.c_str(), "rb");
+				if (file == NULL)
+					return false;
+
+				char magic[8];
+				uint32_t version;
+				uint32_t imageSize;
+				if (fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, traceMagic, sizeof(magic)) != 0 ||
+					fread(&version, sizeof(version), 1, file) != 1 || version != traceVersion ||
+					fread(&imageSize, sizeof(imageSize), 1, file) != 1 || imageSize != sizeof(LinkedMemImage)) {
+					close();
+					return false;
+				}
+
+				dataStart = ftell(file);
+				this->speed = speed;
+				rewind();
+				return true;
+			}
+
+			void close() {
+				if (file != NULL) {
+					fclose(file);
+					file = NULL;
+				}
+			}
+
+			bool isOpen() const { return file != NULL; }
+			bool isFinished() const { return finished; }
+			void setSpeed(double speed) { this->speed = speed; }
+			LinkedMem* getLinkedMem() { return &mem; }
+
+			void rewind() {
+				if (file == NULL)
+					return;
+				fseek(file, dataStart, SEEK_SET);
+				memset(&image, 0, sizeof(image));
+				fromLinkedMemImage(&image, &mem);
+				startTime = getTraceClock();
+				hasPending = false;
+				finished = false;
+			}
+
+			// Applies all frames that are due, returns false once the end of the trace has been reached and nothing was applied
+			bool update() {
+				if (file == NULL || finished)
+					return false;
+
+				double elapsed = (double)(getTraceClock() - startTime) * speed;
+				bool applied = false;
+				while (true) {
+					if (!hasPending) {
+						if (fread(&pendingTimestamp, sizeof(pendingTimestamp), 1, file) != 1) {
+							finished = true;
+							break;
+						}
+						hasPending = true;
+					}
+					if (speed > 0 ? pendingTimestamp > elapsed : applied)
+						break;
+					if (!applyPendingFrame()) {
+						finished = true;
+						break;
+					}
+					hasPending = false;
+					applied = true;
+				}
+
+				if (applied)
+					fromLinkedMemImage(&image, &mem);
+				return applied || !finished;
+			}
+		};
+
+
+		// Link source that feeds a recorded trace into the link instead of the shared memory
+		class ReplayLinkSource : public LinkSource {
+		private:
+			TraceReplayer replayer;
+			std::string path;
+			double speed;
+
+		public:
+			ReplayLinkSource(const std::string& path, double speed) {
+				this->path = path;
+				this->speed = speed;
+			}
+
+			bool open() { return replayer.open(path, speed); }
+			void close() { replayer.close(); }
+			bool isOpen() const { return replayer.isOpen(); }
+			LinkedMem* getLinkedMem() { return replayer.getLinkedMem(); }
+			void update() { replayer.update(); }
+		};
+
+	}
+
+}
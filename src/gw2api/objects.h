@@ -11,11 +11,16 @@
 */
 
 #pragma once
+#include <algorithm>
+#include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include <time.h>
+#include "arena.h"
 #include "math.h"
 #include "requests.h"
+#include "stringpool.h"
 
 namespace Gw2Api {
 
@@ -28,16 +33,130 @@ namespace Gw2Api {
 		bool isCached;
 	};
 
+	/*
+	 * The map entries are templated on the allocator of their strings and arrays (always given as an allocator of char, it's
+	 * rebound where needed). The plain typedefs use the heap, the Arena* typedefs allocate a whole response from one arena.
+	 * Entries can be copied between both with their converting constructors, the copy always uses default constructed
+	 * allocators.
+	 */
+	template<class A, class T>
+	struct RebindAllocator {
+		typedef typename A::template rebind<T>::other type;
+	};
+
+	typedef std::allocator<char> HeapAllocator;
+	typedef ArenaAllocator<char> ResponseArenaAllocator;
+
+	// The heap can be used from any thread
 	template<class T>
-	struct EntryCollection : public std::vector<T> {
+	inline std::allocator<T> makeWorkerAllocator(const std::allocator<T>& allocator) { return allocator; }
+
+	template<class T, class A = HeapAllocator>
+	struct EntryCollection : public std::vector<T, typename RebindAllocator<A, T>::type> {
+		typedef std::vector<T, typename RebindAllocator<A, T>::type> Base;
+
+		EntryCollection() { }
+		explicit EntryCollection(const A& allocator) : Base(allocator) { }
+		template<class U, class B>
+		explicit EntryCollection(const EntryCollection<U, B>& other) : Base(other.begin(), other.end()) { }
 		~EntryCollection() { }
 	};
 
-	template<class K, class V>
-	struct EntryDictionary : public std::map<K, V> { 
+	template<class K, class V, class A = HeapAllocator>
+	struct EntryDictionary : public std::map<K, V, std::less<K>, typename RebindAllocator<A, std::pair<const K, V> >::type> {
 		~EntryDictionary() { }
 	};
 
+	// Integer keys are small ids (maps, regions, worlds), so these dictionaries are stored as an array sorted by key instead
+	// of a tree: lookups are a binary search over contiguous memory and a parsed dictionary is a single allocation
+	template<class V, class A>
+	struct EntryDictionary<int, V, A> {
+		typedef int key_type;
+		typedef V mapped_type;
+		typedef std::pair<int, V> value_type;
+		typedef std::vector<value_type, typename RebindAllocator<A, value_type>::type> Entries;
+		typedef typename Entries::iterator iterator;
+		typedef typename Entries::const_iterator const_iterator;
+		typedef typename Entries::size_type size_type;
+
+	private:
+		Entries entries;
+
+		struct KeyLess {
+			bool operator()(const value_type& lhs, const value_type& rhs) const { return lhs.first < rhs.first; }
+			bool operator()(const value_type& lhs, int rhs) const { return lhs.first < rhs; }
+			bool operator()(int lhs, const value_type& rhs) const { return lhs < rhs.first; }
+		};
+
+		struct KeyEqual {
+			bool operator()(const value_type& lhs, const value_type& rhs) const { return lhs.first == rhs.first; }
+		};
+
+	public:
+		EntryDictionary() { }
+		explicit EntryDictionary(const A& allocator) : entries(allocator) { }
+		template<class U, class B>
+		explicit EntryDictionary(const EntryDictionary<int, U, B>& other) {
+			entries.reserve(other.size());
+			for (typename EntryDictionary<int, U, B>::const_iterator it = other.begin(); it != other.end(); it++)
+				entries.push_back(value_type(it->first, V(it->second)));
+		}
+		~EntryDictionary() { }
+
+		A get_allocator() const { return A(entries.get_allocator()); }
+
+		iterator begin() { return entries.begin(); }
+		iterator end() { return entries.end(); }
+		const_iterator begin() const { return entries.begin(); }
+		const_iterator end() const { return entries.end(); }
+		size_type size() const { return entries.size(); }
+		bool empty() const { return entries.empty(); }
+		void clear() { entries.clear(); }
+
+		iterator lower_bound(int key) { return std::lower_bound(entries.begin(), entries.end(), key, KeyLess()); }
+		const_iterator lower_bound(int key) const { return std::lower_bound(entries.begin(), entries.end(), key, KeyLess()); }
+
+		iterator find(int key) {
+			iterator it = lower_bound(key);
+			return it != entries.end() && it->first == key ? it : entries.end();
+		}
+
+		const_iterator find(int key) const {
+			const_iterator it = lower_bound(key);
+			return it != entries.end() && it->first == key ? it : entries.end();
+		}
+
+		size_type count(int key) const { return find(key) != end() ? 1 : 0; }
+
+		std::pair<iterator, bool> insert(const value_type& entry) {
+			iterator it = lower_bound(entry.first);
+			if (it != entries.end() && it->first == entry.first)
+				return std::pair<iterator, bool>(it, false);
+			return std::pair<iterator, bool>(entries.insert(it, entry), true);
+		}
+
+		V& operator[](int key) {
+			iterator it = lower_bound(key);
+			if (it == entries.end() || it->first != key)
+				it = entries.insert(it, value_type(key, V(get_allocator())));
+			return it->second;
+		}
+
+		// Replaces all entries with the given ones, which may be in any order; like with insert, the first of duplicate keys wins.
+		// The entries are taken over without copying them, the vector is left with the previous entries. Both have to use the
+		// same allocator.
+		void assign(Entries& unsortedEntries) {
+			entries.swap(unsortedEntries);
+			bool sorted = true;
+			for (size_type i = 1; i < entries.size() && sorted; i++)
+				sorted = entries[i - 1].first < entries[i].first;
+			if (!sorted) {
+				std::stable_sort(entries.begin(), entries.end(), KeyLess());
+				entries.erase(std::unique(entries.begin(), entries.end(), KeyEqual()), entries.end());
+			}
+		}
+	};
+
 
 	template<class R, class V>
 	struct ApiInnerResponseObject {
@@ -52,93 +171,190 @@ namespace Gw2Api {
 		V value;
 	};
 
+	/*
+	 * Response whose whole object graph is allocated from its own arena. The destructors of the graph never run, destroying
+	 * the response releases the arena in one go instead of freeing every string and array; so everything in the graph has to
+	 * be allocated from the arena or be trivially destructible (like pooled interned strings; unpooled ones own their copy).
+	 */
+	template<class T>
+	struct ArenaResponseObject : public ApiResponseObject {
+		Arena arena;
+		T* value;
+
+		ArenaResponseObject() {
+			value = new (arena.allocate(sizeof(T))) T(ResponseArenaAllocator(&arena));
+		}
+		~ArenaResponseObject() { }
+
+	private:
+		ArenaResponseObject(const ArenaResponseObject&);
+		ArenaResponseObject& operator=(const ArenaResponseObject&);
+	};
+
+
+	template<class A>
+	struct BasicPointOfInterestEntry {
+		typedef std::basic_string<char, std::char_traits<char>, typename RebindAllocator<A, char>::type> String;
 
-	struct PointOfInterestEntry {
 		int poi_id;
-		std::string name;
-		std::string type;
+		String name;
+		String type;
 		int floor;
 		Vector2D coord;
+
+		explicit BasicPointOfInterestEntry(const A& allocator = A()) : name(allocator), type(allocator) { }
+		template<class B>
+		BasicPointOfInterestEntry(const BasicPointOfInterestEntry<B>& other) : poi_id(other.poi_id), name(other.name.c_str(), other.name.length()),
+			type(other.type.c_str(), other.type.length()), floor(other.floor), coord(other.coord) { }
 	};
+	typedef BasicPointOfInterestEntry<HeapAllocator> PointOfInterestEntry;
 	typedef EntryCollection<PointOfInterestEntry> PointOfInterestEntries;
 
-	struct TaskEntry {
+	template<class A>
+	struct BasicTaskEntry {
+		typedef std::basic_string<char, std::char_traits<char>, typename RebindAllocator<A, char>::type> String;
+
 		int task_id;
-		std::string objective;
+		String objective;
 		int level;
 		Vector2D coord;
+
+		explicit BasicTaskEntry(const A& allocator = A()) : objective(allocator) { }
+		template<class B>
+		BasicTaskEntry(const BasicTaskEntry<B>& other) : task_id(other.task_id), objective(other.objective.c_str(), other.objective.length()),
+			level(other.level), coord(other.coord) { }
 	};
+	typedef BasicTaskEntry<HeapAllocator> TaskEntry;
 	typedef EntryCollection<TaskEntry> TaskEntries;
 
 	struct SkillChallengeEntry {
 		Vector2D coord;
+
+		SkillChallengeEntry() { }
+		template<class A>
+		explicit SkillChallengeEntry(const A&) { }
 	};
 	typedef EntryCollection<SkillChallengeEntry> SkillChallengeEntries;
 
-	struct SectorEntry {
+	template<class A>
+	struct BasicSectorEntry {
+		typedef std::basic_string<char, std::char_traits<char>, typename RebindAllocator<A, char>::type> String;
+
 		int sector_id;
-		std::string name;
+		String name;
 		int level;
 		Vector2D coord;
+
+		explicit BasicSectorEntry(const A& allocator = A()) : name(allocator) { }
+		template<class B>
+		BasicSectorEntry(const BasicSectorEntry<B>& other) : sector_id(other.sector_id), name(other.name.c_str(), other.name.length()),
+			level(other.level), coord(other.coord) { }
 	};
+	typedef BasicSectorEntry<HeapAllocator> SectorEntry;
 	typedef EntryCollection<SectorEntry> SectorEntries;
 
-	struct MapFloorEntry {
-		std::string name;
+	template<class A>
+	struct BasicMapFloorEntry {
+		InternedString name;
 		int min_level;
 		int max_level;
 		int default_floor;
 		Rect map_rect;
 		Rect continent_rect;
-		PointOfInterestEntries points_of_interest;
-		TaskEntries tasks;
-		SkillChallengeEntries skill_challenges;
-		SectorEntries sectors;
-	};
+		EntryCollection<BasicPointOfInterestEntry<A>, A> points_of_interest;
+		EntryCollection<BasicTaskEntry<A>, A> tasks;
+		EntryCollection<SkillChallengeEntry, A> skill_challenges;
+		EntryCollection<BasicSectorEntry<A>, A> sectors;
 
-	struct MapFloorEntries : public ApiResponseObject, public EntryDictionary<int, MapFloorEntry> {
-		~MapFloorEntries() { }
+		explicit BasicMapFloorEntry(const A& allocator = A()) : points_of_interest(allocator), tasks(allocator), skill_challenges(allocator), sectors(allocator) { }
+		template<class B>
+		BasicMapFloorEntry(const BasicMapFloorEntry<B>& other) : name(other.name), min_level(other.min_level), max_level(other.max_level),
+			default_floor(other.default_floor), map_rect(other.map_rect), continent_rect(other.continent_rect),
+			points_of_interest(other.points_of_interest), tasks(other.tasks), skill_challenges(other.skill_challenges), sectors(other.sectors) { }
 	};
+	typedef BasicMapFloorEntry<HeapAllocator> MapFloorEntry;
+	typedef EntryDictionary<int, MapFloorEntry> MapFloorEntries;
 
-	struct MapFloorRegionEntry {
-		std::string name;
+	template<class A>
+	struct BasicMapFloorRegionEntry {
+		InternedString name;
 		Vector2D label_coord;
-		MapFloorEntries maps;
+		EntryDictionary<int, BasicMapFloorEntry<A>, A> maps;
+
+		explicit BasicMapFloorRegionEntry(const A& allocator = A()) : maps(allocator) { }
+		template<class B>
+		BasicMapFloorRegionEntry(const BasicMapFloorRegionEntry<B>& other) : name(other.name), label_coord(other.label_coord), maps(other.maps) { }
 	};
+	typedef BasicMapFloorRegionEntry<HeapAllocator> MapFloorRegionEntry;
 	typedef EntryDictionary<int, MapFloorRegionEntry> MapFloorRegionEntries;
 
-	struct MapFloorRootEntry : public ApiResponseObject {
-		~MapFloorRootEntry() { }
-
+	template<class A>
+	struct BasicMapFloorRootEntry {
 		Vector2D texture_dims;
 		Rect clamped_view;
-		MapFloorRegionEntries regions;
+		EntryDictionary<int, BasicMapFloorRegionEntry<A>, A> regions;
+
+		explicit BasicMapFloorRootEntry(const A& allocator = A()) : regions(allocator) { }
+		template<class B>
+		BasicMapFloorRootEntry(const BasicMapFloorRootEntry<B>& other) : texture_dims(other.texture_dims), clamped_view(other.clamped_view), regions(other.regions) { }
+	};
+
+	struct MapFloorRootEntry : public ApiResponseObject, public BasicMapFloorRootEntry<HeapAllocator> {
+		MapFloorRootEntry() { }
+		template<class B>
+		explicit MapFloorRootEntry(const BasicMapFloorRootEntry<B>& other) : BasicMapFloorRootEntry<HeapAllocator>(other) { }
+		~MapFloorRootEntry() { }
 	};
+	typedef ArenaResponseObject<BasicMapFloorRootEntry<ResponseArenaAllocator> > ArenaMapFloorRootEntry;
 
-	struct MapEntry {
-		std::string map_name;
+	template<class A>
+	struct BasicMapEntry {
+		InternedString map_name;
 		int min_level;
 		int max_level;
 		int default_floor;
-		std::vector<int> floors;
+		std::vector<int, typename RebindAllocator<A, int>::type> floors;
 		int region_id;
-		std::string region_name;
+		InternedString region_name;
 		int continent_id;
-		std::string continent_name;
+		InternedString continent_name;
 		Rect map_rect;
 		Rect continent_rect;
+
+		explicit BasicMapEntry(const A& allocator = A()) : floors(allocator) { }
+		template<class B>
+		BasicMapEntry(const BasicMapEntry<B>& other) : map_name(other.map_name), min_level(other.min_level), max_level(other.max_level),
+			default_floor(other.default_floor), floors(other.floors.begin(), other.floors.end()), region_id(other.region_id),
+			region_name(other.region_name), continent_id(other.continent_id), continent_name(other.continent_name),
+			map_rect(other.map_rect), continent_rect(other.continent_rect) { }
 	};
+	typedef BasicMapEntry<HeapAllocator> MapEntry;
 	typedef EntryDictionary<int, MapEntry> MapEntries;
 
-	struct MapsRootEntry : public ApiResponseObject {
-		~MapsRootEntry() { }
+	template<class A>
+	struct BasicMapsRootEntry {
+		EntryDictionary<int, BasicMapEntry<A>, A> maps;
+
+		explicit BasicMapsRootEntry(const A& allocator = A()) : maps(allocator) { }
+		template<class B>
+		BasicMapsRootEntry(const BasicMapsRootEntry<B>& other) : maps(other.maps) { }
+	};
 
-		MapEntries maps;
+	struct MapsRootEntry : public ApiResponseObject, public BasicMapsRootEntry<HeapAllocator> {
+		MapsRootEntry() { }
+		template<class B>
+		explicit MapsRootEntry(const BasicMapsRootEntry<B>& other) : BasicMapsRootEntry<HeapAllocator>(other) { }
+		~MapsRootEntry() { }
 	};
+	typedef ArenaResponseObject<BasicMapsRootEntry<ResponseArenaAllocator> > ArenaMapsRootEntry;
 
 	struct WorldNameEntry {
 		int id;
-		std::string name;
+		InternedString name;
+
+		WorldNameEntry() { }
+		template<class A>
+		explicit WorldNameEntry(const A&) { }
 	};
 	typedef EntryDictionary<int, WorldNameEntry> WorldNameEntries;
 
@@ -148,4 +364,11 @@ namespace Gw2Api {
 		WorldNameEntries world_names;
 	};
 
+	// The maps of one region of a continent floor, as returned by the v2 API
+	struct ContinentMapsRootEntry : public ApiResponseObject {
+		~ContinentMapsRootEntry() { }
+
+		MapFloorEntries maps;
+	};
+
 }
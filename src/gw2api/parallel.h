@@ -0,0 +1,98 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <stddef.h>
+#include <Windows.h>
+
+namespace Gw2Api {
+
+	namespace Parallel {
+
+		// Upper limit of threads working on one job, parsing doesn't scale much further
+		const unsigned maxWorkers = 4;
+
+		template<class F>
+		struct Job {
+			F* function;
+			LONG count;
+			volatile LONG nextIndex;
+			volatile LONG nextWorker;
+			volatile LONG pendingWorkers;
+			HANDLE finished;
+
+			void run() {
+				LONG worker = InterlockedIncrement(&nextWorker) - 1;
+				LONG index;
+				while ((index = InterlockedIncrement(&nextIndex) - 1) < count)
+					(*function)((size_t)index, (unsigned)worker);
+			}
+
+			static void CALLBACK workerCallback(PTP_CALLBACK_INSTANCE, PVOID context) {
+				Job* job = (Job*)context;
+				job->run();
+				// The job may be gone as soon as the last worker signals it
+				if (InterlockedDecrement(&job->pendingWorkers) == 0)
+					SetEvent(job->finished);
+			}
+		};
+
+		// Number of workers that parallelFor will use at most for the given number of items
+		inline unsigned getWorkerCount(size_t count) {
+			SYSTEM_INFO systemInfo;
+			GetSystemInfo(&systemInfo);
+			unsigned workers = systemInfo.dwNumberOfProcessors > 0 ? (unsigned)systemInfo.dwNumberOfProcessors : 1;
+			if (workers > maxWorkers)
+				workers = maxWorkers;
+			if (workers > count)
+				workers = count > 0 ? (unsigned)count : 1;
+			return workers;
+		}
+
+		/*
+		 * Calls function(index, worker) for every index below count, spread over up to the given number of workers on the system
+		 * thread pool. The calling thread is one of the workers, worker is a number below workers that is unique for every thread
+		 * taking part. Returns once all calls have finished; the function must not throw.
+		 */
+		template<class F>
+		inline void parallelFor(size_t count, unsigned workers, F& function) {
+			Job<F> job;
+			job.function = &function;
+			job.count = (LONG)count;
+			job.nextIndex = 0;
+			job.nextWorker = 0;
+			job.pendingWorkers = 1; // The calling thread
+			job.finished = NULL;
+
+			if (workers > 1 && count > 1)
+				job.finished = CreateEventW(NULL, TRUE, FALSE, NULL);
+			if (job.finished != NULL) {
+				for (unsigned i = 1; i < workers; i++) {
+					InterlockedIncrement(&job.pendingWorkers);
+					if (!TrySubmitThreadpoolCallback(Job<F>::workerCallback, &job, NULL)) {
+						// Fewer workers just take longer
+						InterlockedDecrement(&job.pendingWorkers);
+						break;
+					}
+				}
+			}
+
+			job.run();
+			if (InterlockedDecrement(&job.pendingWorkers) != 0)
+				WaitForSingleObject(job.finished, INFINITE);
+			if (job.finished != NULL)
+				CloseHandle(job.finished);
+		}
+
+	}
+
+}
@@ -11,9 +11,12 @@
 */
 
 #pragma once
+#include <new>
+#include <string.h>
 #include <string>
 #include "rapidjson/document.h"
 #include "objects.h"
+#include "parallel.h"
 #include "requests.h"
 
 
@@ -26,6 +29,24 @@ namespace Gw2Api {
 		typedef rapidjson::SizeType RJSizeType;
 		typedef rapidjson::Value::ConstMemberIterator RJIterator;
 
+		// Returned for absent members, initialized when the module is loaded
+		static const RJValue rj_null;
+
+		/*
+		 * Looks up a member of an object like operator[], which returns a function-local static for absent members. VS2010 doesn't
+		 * initialize those thread-safely, and parsers also run on worker threads (see ParallelMapFloorRegionsParser).
+		 */
+		inline const RJValue& getMember(const RJValue& object, const char* name) {
+			if (!object.IsObject())
+				return rj_null;
+			size_t length = strlen(name);
+			for (RJIterator member = object.MemberBegin(); member != object.MemberEnd(); member++) {
+				if (member->name.GetStringLength() == length && memcmp(member->name.GetString(), name, length) == 0)
+					return member->value;
+			}
+			return rj_null;
+		}
+
 
 		template<class T>
 		class ApiResponseParser {
@@ -43,14 +64,24 @@ namespace Gw2Api {
 				parseJsonString(jsonString, &jsonObj);
 				return parse(jsonObj, result);
 			}
+
+			// Parses a zero-terminated buffer in place, string values stay in the buffer until they are copied into the result.
+			// The buffer is modified and can't be parsed again afterwards.
+			virtual bool parseInsitu(char* json, T* result) const {
+				RJDoc jsonObj;
+				if (jsonObj.ParseInsitu<0>(json).HasParseError())
+					return false;
+				return parse(jsonObj, result);
+			}
 		};
 
-		template<class T>
-		class ArrayParser : public ApiResponseParser<std::vector<T>> {
+		template<class T, class A = HeapAllocator>
+		class ArrayParser : public ApiResponseParser<std::vector<T, typename RebindAllocator<A, T>::type> > {
 		public:
-			bool parse(const RJValue& jsonValue, std::vector<T>* result) const {
+			bool parse(const RJValue& jsonValue, std::vector<T, typename RebindAllocator<A, T>::type>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsArray()) return false;
 
+				result->reserve(result->size() + jsonValue.Size());
 				for (RJSizeType i = 0; i < jsonValue.Size(); i++) {
 					if (!jsonValue[i].IsNull() && jsonValue[i].IsInt()) result->push_back((T)jsonValue[i].GetInt());
 					else if (!jsonValue[i].IsNull() && jsonValue[i].IsInt64()) result->push_back((T)jsonValue[i].GetInt64());
@@ -62,45 +93,46 @@ namespace Gw2Api {
 			}
 		};
 
-		template<class T, class P>
-		class EntryCollectionParser : public ApiResponseParser<EntryCollection<T>> {
+		// Entries are created with the allocator of the collection and parsed in place
+		template<class T, class P, class A = HeapAllocator>
+		class EntryCollectionParser : public ApiResponseParser<EntryCollection<T, A> > {
 		public:
-			bool parse(const RJValue& jsonValue, EntryCollection<T>* result) const {
+			bool parse(const RJValue& jsonValue, EntryCollection<T, A>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsArray()) return false;
 				
+				A allocator(result->get_allocator());
+				result->reserve(result->size() + jsonValue.Size());
 				P parser;
 				for (RJSizeType i = 0; i < jsonValue.Size(); i++) {
-					T entry;
-					if (parser.parse(jsonValue[i], &entry)) {
-						result->push_back(entry);
-					} else {
+					result->push_back(T(allocator));
+					if (!parser.parse(jsonValue[i], &result->back()))
 						return false;
-					}
 				}
 				return true;
 			}
 		};
 		
-		template<class K, class V, class P>
-		class EntryDictionaryParser : public ApiResponseParser<EntryDictionary<K, V>> {
+		template<class K, class V, class P, class A = HeapAllocator>
+		class EntryDictionaryParser : public ApiResponseParser<EntryDictionary<K, V, A> > {
 		public:
-			bool parse(const RJValue& jsonValue, EntryDictionary<K, V>* result) const {
+			bool parse(const RJValue& jsonValue, EntryDictionary<K, V, A>* result) const {
 				return false;
 			}
 		};
 
-		template<class V, class P>
-		class EntryDictionaryParser<std::string, V, P> : public ApiResponseParser<EntryDictionary<std::string, V>> {
+		template<class V, class P, class A>
+		class EntryDictionaryParser<std::string, V, P, A> : public ApiResponseParser<EntryDictionary<std::string, V, A> > {
 		public:
-			bool parse(const RJValue& jsonValue, EntryDictionary<std::string, V>* result) const {
+			bool parse(const RJValue& jsonValue, EntryDictionary<std::string, V, A>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
+				A allocator(result->get_allocator());
 				P parser;
 				for (RJIterator i = jsonValue.MemberBegin(); i != jsonValue.MemberEnd(); i++) {
 					std::string key = i->name.GetString();
-					V entry;
+					V entry(allocator);
 					if (parser.parse(i->value, &entry)) {
-						result->insert(EntryDictionary<std::string, V>::value_type(key, entry));
+						result->insert(typename EntryDictionary<std::string, V, A>::value_type(key, entry));
 					} else {
 						return false;
 					}
@@ -109,26 +141,42 @@ namespace Gw2Api {
 			}
 		};
 
-		template<class V, class P>
-		class EntryDictionaryParser<int, V, P> : public ApiResponseParser<EntryDictionary<int, V>> {
+		template<class V, class P, class A>
+		class EntryDictionaryParser<int, V, P, A> : public ApiResponseParser<EntryDictionary<int, V, A> > {
 		public:
-			bool parse(const RJValue& jsonValue, EntryDictionary<int, V>* result) const {
+			bool parse(const RJValue& jsonValue, EntryDictionary<int, V, A>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
+				// Parse straight into the final array and sort it once at the end
+				A allocator(result->get_allocator());
+				typename EntryDictionary<int, V, A>::Entries entries(allocator);
+				entries.reserve(jsonValue.MemberEnd() - jsonValue.MemberBegin());
 				P parser;
 				for (RJIterator i = jsonValue.MemberBegin(); i != jsonValue.MemberEnd(); i++) {
-					int key = atoi(i->name.GetString());
-					V entry;
-					if (parser.parse(i->value, &entry)) {
-						result->insert(EntryDictionary<int, V>::value_type(key, entry));
-					} else {
+					entries.push_back(typename EntryDictionary<int, V, A>::value_type(atoi(i->name.GetString()), V(allocator)));
+					if (!parser.parse(i->value, &entries.back().second))
 						return false;
-					}
 				}
+				result->assign(entries);
 				return true;
 			}
 		};
 
+		// Parses a response into the arena of an ArenaResponseObject, with a parser for the arena allocated value
+		template<class T, class P>
+		class ArenaResponseParser : public ApiResponseParser<ArenaResponseObject<T> > {
+		private:
+			P parser;
+
+		public:
+			ArenaResponseParser() { }
+			explicit ArenaResponseParser(const P& parser) : parser(parser) { }
+
+			bool parse(const RJValue& jsonValue, ArenaResponseObject<T>* result) const {
+				return parser.parse(jsonValue, result->value);
+			}
+		};
+
 
 		class Vector2DParser : public ApiResponseParser<Vector2D> {
 		public:
@@ -160,20 +208,21 @@ namespace Gw2Api {
 			}
 		};
 
-		class PointOfInterestParser : public ApiResponseParser<PointOfInterestEntry> {
+		template<class A>
+		class BasicPointOfInterestParser : public ApiResponseParser<BasicPointOfInterestEntry<A> > {
 		public:
-			bool parse(const RJValue& jsonValue, PointOfInterestEntry* result) const {
+			bool parse(const RJValue& jsonValue, BasicPointOfInterestEntry<A>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
-				const RJValue& rj_poi_id = jsonValue["poi_id"];
-				const RJValue& rj_name = jsonValue["name"];
-				const RJValue& rj_type = jsonValue["type"];
-				const RJValue& rj_floor = jsonValue["floor"];
-				const RJValue& rj_coord = jsonValue["coord"];
+				const RJValue& rj_poi_id = getMember(jsonValue, "poi_id");
+				const RJValue& rj_name = getMember(jsonValue, "name");
+				const RJValue& rj_type = getMember(jsonValue, "type");
+				const RJValue& rj_floor = getMember(jsonValue, "floor");
+				const RJValue& rj_coord = getMember(jsonValue, "coord");
 
 				if (!rj_poi_id.IsNull() && rj_poi_id.IsInt())	result->poi_id = rj_poi_id.GetInt();
-				if (!rj_name.IsNull() && rj_name.IsString())	result->name = rj_name.GetString();
-				if (!rj_type.IsNull() && rj_type.IsString())	result->type = rj_type.GetString();
+				if (!rj_name.IsNull() && rj_name.IsString())	result->name.assign(rj_name.GetString(), rj_name.GetStringLength());
+				if (!rj_type.IsNull() && rj_type.IsString())	result->type.assign(rj_type.GetString(), rj_type.GetStringLength());
 				if (!rj_floor.IsNull() && rj_floor.IsInt())		result->floor = rj_floor.GetInt();
 				bool success = true;
 				Vector2DParser vector2DParser;
@@ -181,20 +230,22 @@ namespace Gw2Api {
 				return success;
 			}
 		};
+		typedef BasicPointOfInterestParser<HeapAllocator> PointOfInterestParser;
 		typedef EntryCollectionParser<PointOfInterestEntry, PointOfInterestParser> PointsOfInterestParser;
 
-		class TaskParser : public ApiResponseParser<TaskEntry> {
+		template<class A>
+		class BasicTaskParser : public ApiResponseParser<BasicTaskEntry<A> > {
 		public:
-			bool parse(const RJValue& jsonValue, TaskEntry* result) const {
+			bool parse(const RJValue& jsonValue, BasicTaskEntry<A>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
-				const RJValue& rj_task_id = jsonValue["task_id"];
-				const RJValue& rj_objective = jsonValue["objective"];
-				const RJValue& rj_level = jsonValue["level"];
-				const RJValue& rj_coord = jsonValue["coord"];
+				const RJValue& rj_task_id = getMember(jsonValue, "task_id");
+				const RJValue& rj_objective = getMember(jsonValue, "objective");
+				const RJValue& rj_level = getMember(jsonValue, "level");
+				const RJValue& rj_coord = getMember(jsonValue, "coord");
 
 				if (!rj_task_id.IsNull() && rj_task_id.IsInt())			result->task_id = rj_task_id.GetInt();
-				if (!rj_objective.IsNull() && rj_objective.IsString())	result->objective = rj_objective.GetString();
+				if (!rj_objective.IsNull() && rj_objective.IsString())	result->objective.assign(rj_objective.GetString(), rj_objective.GetStringLength());
 				if (!rj_level.IsNull() && rj_level.IsInt())				result->level = rj_level.GetInt();
 				bool success = true;
 				Vector2DParser vector2DParser;
@@ -202,6 +253,7 @@ namespace Gw2Api {
 				return success;
 			}
 		};
+		typedef BasicTaskParser<HeapAllocator> TaskParser;
 		typedef EntryCollectionParser<TaskEntry, TaskParser> TasksParser;
 
 		class SkillChallengeParser : public ApiResponseParser<SkillChallengeEntry> {
@@ -209,7 +261,7 @@ namespace Gw2Api {
 			bool parse(const RJValue& jsonValue, SkillChallengeEntry* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
-				const RJValue& rj_coord = jsonValue["coord"];
+				const RJValue& rj_coord = getMember(jsonValue, "coord");
 
 				bool success = true;
 				Vector2DParser vector2DParser;
@@ -219,18 +271,19 @@ namespace Gw2Api {
 		};
 		typedef EntryCollectionParser<SkillChallengeEntry, SkillChallengeParser> SkillChallengesParser;
 
-		class SectorParser : public ApiResponseParser<SectorEntry> {
+		template<class A>
+		class BasicSectorParser : public ApiResponseParser<BasicSectorEntry<A> > {
 		public:
-			bool parse(const RJValue& jsonValue, SectorEntry* result) const {
+			bool parse(const RJValue& jsonValue, BasicSectorEntry<A>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
-				const RJValue& rj_sector_id = jsonValue["sector_id"];
-				const RJValue& rj_name = jsonValue["name"];
-				const RJValue& rj_level = jsonValue["level"];
-				const RJValue& rj_coord = jsonValue["coord"];
+				const RJValue& rj_sector_id = getMember(jsonValue, "sector_id");
+				const RJValue& rj_name = getMember(jsonValue, "name");
+				const RJValue& rj_level = getMember(jsonValue, "level");
+				const RJValue& rj_coord = getMember(jsonValue, "coord");
 
 				if (!rj_sector_id.IsNull() && rj_sector_id.IsInt())	result->sector_id = rj_sector_id.GetInt();
-				if (!rj_name.IsNull() && rj_name.IsString())		result->name = rj_name.GetString();
+				if (!rj_name.IsNull() && rj_name.IsString())		result->name.assign(rj_name.GetString(), rj_name.GetStringLength());
 				if (!rj_level.IsNull() && rj_level.IsInt())			result->level = rj_level.GetInt();
 				bool success = true;
 				Vector2DParser vector2DParser;
@@ -238,34 +291,36 @@ namespace Gw2Api {
 				return success;
 			}
 		};
+		typedef BasicSectorParser<HeapAllocator> SectorParser;
 		typedef EntryCollectionParser<SectorEntry, SectorParser> SectorsParser;
 
-		class MapFloorParser : public ApiResponseParser<MapFloorEntry> {
+		template<class A>
+		class BasicMapFloorParser : public ApiResponseParser<BasicMapFloorEntry<A> > {
 		public:
-			bool parse(const RJValue& jsonValue, MapFloorEntry* result) const {
+			bool parse(const RJValue& jsonValue, BasicMapFloorEntry<A>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
-				const RJValue& rj_name = jsonValue["name"];
-				const RJValue& rj_min_level = jsonValue["min_level"];
-				const RJValue& rj_max_level = jsonValue["max_level"];
-				const RJValue& rj_default_floor = jsonValue["default_floor"];
-				const RJValue& rj_map_rect = jsonValue["map_rect"];
-				const RJValue& rj_continent_rect = jsonValue["continent_rect"];
-				const RJValue& rj_points_of_interest = jsonValue["points_of_interest"];
-				const RJValue& rj_tasks = jsonValue["tasks"];
-				const RJValue& rj_skill_challenges = jsonValue["skill_challenges"];
-				const RJValue& rj_sectors = jsonValue["sectors"];
-
-				if (!rj_name.IsNull() && rj_name.IsString())				result->name = rj_name.GetString();
+				const RJValue& rj_name = getMember(jsonValue, "name");
+				const RJValue& rj_min_level = getMember(jsonValue, "min_level");
+				const RJValue& rj_max_level = getMember(jsonValue, "max_level");
+				const RJValue& rj_default_floor = getMember(jsonValue, "default_floor");
+				const RJValue& rj_map_rect = getMember(jsonValue, "map_rect");
+				const RJValue& rj_continent_rect = getMember(jsonValue, "continent_rect");
+				const RJValue& rj_points_of_interest = getMember(jsonValue, "points_of_interest");
+				const RJValue& rj_tasks = getMember(jsonValue, "tasks");
+				const RJValue& rj_skill_challenges = getMember(jsonValue, "skill_challenges");
+				const RJValue& rj_sectors = getMember(jsonValue, "sectors");
+
+				if (!rj_name.IsNull() && rj_name.IsString())				result->name = InternedString(rj_name.GetString(), rj_name.GetStringLength());
 				if (!rj_min_level.IsNull() && rj_min_level.IsInt())			result->min_level = rj_min_level.GetInt();
 				if (!rj_max_level.IsNull() && rj_max_level.IsInt())			result->max_level = rj_max_level.GetInt();
 				if (!rj_default_floor.IsNull() && rj_default_floor.IsInt())	result->default_floor = rj_default_floor.GetInt();
 				bool success = true;
 				RectParser rectParser;
-				PointsOfInterestParser pointsOfInterestParser;
-				TasksParser tasksParser;
-				SkillChallengesParser skillChallengesParser;
-				SectorsParser sectorsParser;
+				EntryCollectionParser<BasicPointOfInterestEntry<A>, BasicPointOfInterestParser<A>, A> pointsOfInterestParser;
+				EntryCollectionParser<BasicTaskEntry<A>, BasicTaskParser<A>, A> tasksParser;
+				EntryCollectionParser<SkillChallengeEntry, SkillChallengeParser, A> skillChallengesParser;
+				EntryCollectionParser<BasicSectorEntry<A>, BasicSectorParser<A>, A> sectorsParser;
 				if (!rj_map_rect.IsNull())				success &= rectParser.parse(rj_map_rect, &result->map_rect);
 				if (!rj_continent_rect.IsNull())		success &= rectParser.parse(rj_continent_rect, &result->continent_rect);
 				if (!rj_points_of_interest.IsNull())	success &= pointsOfInterestParser.parse(rj_points_of_interest, &result->points_of_interest);
@@ -275,75 +330,164 @@ namespace Gw2Api {
 				return success;
 			}
 		};
+		typedef BasicMapFloorParser<HeapAllocator> MapFloorParser;
 		typedef EntryDictionaryParser<int, MapFloorEntry, MapFloorParser> MapFloorsParser;
 
-		class MapFloorRegionParser : public ApiResponseParser<MapFloorRegionEntry> {
+		template<class A>
+		class BasicMapFloorRegionParser : public ApiResponseParser<BasicMapFloorRegionEntry<A> > {
 		public:
-			bool parse(const RJValue& jsonValue, MapFloorRegionEntry* result) const {
+			bool parse(const RJValue& jsonValue, BasicMapFloorRegionEntry<A>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
-				const RJValue& rj_name = jsonValue["name"];
-				const RJValue& rj_label_coord = jsonValue["label_coord"];
-				const RJValue& rj_maps = jsonValue["maps"];
+				const RJValue& rj_name = getMember(jsonValue, "name");
+				const RJValue& rj_label_coord = getMember(jsonValue, "label_coord");
+				const RJValue& rj_maps = getMember(jsonValue, "maps");
 
-				if (!rj_name.IsNull() && rj_name.IsString()) result->name = rj_name.GetString();
+				if (!rj_name.IsNull() && rj_name.IsString()) result->name = InternedString(rj_name.GetString(), rj_name.GetStringLength());
 				bool success = true;
 				Vector2DParser vector2DParser;
-				MapFloorsParser mapFloorsParser;
+				EntryDictionaryParser<int, BasicMapFloorEntry<A>, BasicMapFloorParser<A>, A> mapFloorsParser;
 				if (!rj_label_coord.IsNull())	success &= vector2DParser.parse(rj_label_coord, &result->label_coord);
 				if (!rj_maps.IsNull())			success &= mapFloorsParser.parse(rj_maps, &result->maps);
 				return success;
 			}
 		};
+		typedef BasicMapFloorRegionParser<HeapAllocator> MapFloorRegionParser;
 		typedef EntryDictionaryParser<int, MapFloorRegionEntry, MapFloorRegionParser> MapFloorRegionsParser;
 
-		class MapFloorRootParser : public ApiResponseParser<MapFloorRootEntry> {
+		/*
+		 * Converts the regions of a map floor concurrently, regions are by far the largest parts of a map floor and independent of
+		 * each other. Every worker builds its regions with its own allocator, see makeWorkerAllocator. Only the conversion of the
+		 * already parsed document is concurrent, the JSON text itself is still parsed on the calling thread.
+		 */
+		template<class A>
+		class ParallelMapFloorRegionsParser : public ApiResponseParser<EntryDictionary<int, BasicMapFloorRegionEntry<A>, A> > {
+		private:
+			typedef EntryDictionary<int, BasicMapFloorRegionEntry<A>, A> Regions;
+
+			struct RegionTask {
+				RJIterator members;
+				typename Regions::Entries* entries;
+				std::vector<A>* workerAllocators;
+				volatile LONG failed;
+
+				void operator()(size_t index, unsigned worker) {
+					BasicMapFloorRegionEntry<A>* region = &(*entries)[index].second;
+					try {
+						// Rebuild the still empty placeholder with the allocator of this worker
+						region->~BasicMapFloorRegionEntry<A>();
+						new (region) BasicMapFloorRegionEntry<A>((*workerAllocators)[worker]);
+						BasicMapFloorRegionParser<A> parser;
+						if (!parser.parse(members[index].value, region))
+							InterlockedExchange(&failed, 1);
+					} catch (const std::bad_alloc&) {
+						InterlockedExchange(&failed, 1);
+					}
+				}
+			};
+
 		public:
-			bool parse(const RJValue& jsonValue, MapFloorRootEntry* result) const {
+			bool parse(const RJValue& jsonValue, Regions* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
-				const RJValue& rj_texture_dims = jsonValue["texture_dims"];
-				const RJValue& rj_clamped_view = jsonValue["clamped_view"];
-				const RJValue& rj_regions = jsonValue["regions"];
+				A allocator(result->get_allocator());
+				typename Regions::Entries entries(allocator);
+				entries.reserve(jsonValue.MemberEnd() - jsonValue.MemberBegin());
+				for (RJIterator i = jsonValue.MemberBegin(); i != jsonValue.MemberEnd(); i++)
+					entries.push_back(typename Regions::value_type(atoi(i->name.GetString()), BasicMapFloorRegionEntry<A>(allocator)));
+
+				unsigned workers = Parallel::getWorkerCount(entries.size());
+				std::vector<A> workerAllocators;
+				for (unsigned i = 0; i < workers; i++)
+					workerAllocators.push_back(makeWorkerAllocator(allocator));
+
+				RegionTask task;
+				task.members = jsonValue.MemberBegin();
+				task.entries = &entries;
+				task.workerAllocators = &workerAllocators;
+				task.failed = 0;
+				Parallel::parallelFor(entries.size(), workers, task);
+				if (task.failed)
+					return false;
+
+				result->assign(entries);
+				return true;
+			}
+		};
+
+		template<class A>
+		class BasicMapFloorRootParser : public ApiResponseParser<BasicMapFloorRootEntry<A> > {
+		private:
+			bool parallelRegions;
+
+		public:
+			// With parallelRegions the regions are parsed on multiple threads, which pays off for large floors with cold caches
+			explicit BasicMapFloorRootParser(bool parallelRegions = false) {
+				this->parallelRegions = parallelRegions;
+			}
+
+			bool parse(const RJValue& jsonValue, BasicMapFloorRootEntry<A>* result) const {
+				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
+
+				const RJValue& rj_texture_dims = getMember(jsonValue, "texture_dims");
+				const RJValue& rj_clamped_view = getMember(jsonValue, "clamped_view");
+				const RJValue& rj_regions = getMember(jsonValue, "regions");
 
 				bool success = true;
 				Vector2DParser vector2DParser;
 				RectParser rectParser;
-				MapFloorRegionsParser mapFloorRegionsParser;
+				EntryDictionaryParser<int, BasicMapFloorRegionEntry<A>, BasicMapFloorRegionParser<A>, A> mapFloorRegionsParser;
 				if (!rj_texture_dims.IsNull())	success &= vector2DParser.parse(rj_texture_dims, &result->texture_dims);
 				if (!rj_clamped_view.IsNull())	success &= rectParser.parse(rj_clamped_view, &result->clamped_view);
-				if (!rj_regions.IsNull())		success &= mapFloorRegionsParser.parse(rj_regions, &result->regions);
+				if (!rj_regions.IsNull()) {
+					if (parallelRegions) {
+						ParallelMapFloorRegionsParser<A> parallelMapFloorRegionsParser;
+						success &= parallelMapFloorRegionsParser.parse(rj_regions, &result->regions);
+					} else {
+						success &= mapFloorRegionsParser.parse(rj_regions, &result->regions);
+					}
+				}
 				return success;
 			}
 		};
 
-		class MapParser : public ApiResponseParser<MapEntry> {
+		class MapFloorRootParser : public ApiResponseParser<MapFloorRootEntry> {
 		public:
-			bool parse(const RJValue& jsonValue, MapEntry* result) const {
+			bool parse(const RJValue& jsonValue, MapFloorRootEntry* result) const {
+				BasicMapFloorRootParser<HeapAllocator> parser;
+				return parser.parse(jsonValue, result);
+			}
+		};
+		typedef ArenaResponseParser<BasicMapFloorRootEntry<ResponseArenaAllocator>, BasicMapFloorRootParser<ResponseArenaAllocator> > ArenaMapFloorRootParser;
+
+		template<class A>
+		class BasicMapParser : public ApiResponseParser<BasicMapEntry<A> > {
+		public:
+			bool parse(const RJValue& jsonValue, BasicMapEntry<A>* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 
-				const RJValue& rj_map_name = jsonValue["map_name"];
-				const RJValue& rj_min_level = jsonValue["min_level"];
-				const RJValue& rj_max_level = jsonValue["max_level"];
-				const RJValue& rj_default_floor = jsonValue["default_floor"];
-				const RJValue& rj_floors = jsonValue["floors"];
-				const RJValue& rj_region_id = jsonValue["region_id"];
-				const RJValue& rj_region_name = jsonValue["region_name"];
-				const RJValue& rj_continent_id = jsonValue["continent_id"];
-				const RJValue& rj_continent_name = jsonValue["continent_name"];
-				const RJValue& rj_map_rect = jsonValue["map_rect"];
-				const RJValue& rj_continent_rect = jsonValue["continent_rect"];
-
-				if (!rj_map_name.IsNull() && rj_map_name.IsString())				result->map_name = rj_map_name.GetString();
+				const RJValue& rj_map_name = getMember(jsonValue, "map_name");
+				const RJValue& rj_min_level = getMember(jsonValue, "min_level");
+				const RJValue& rj_max_level = getMember(jsonValue, "max_level");
+				const RJValue& rj_default_floor = getMember(jsonValue, "default_floor");
+				const RJValue& rj_floors = getMember(jsonValue, "floors");
+				const RJValue& rj_region_id = getMember(jsonValue, "region_id");
+				const RJValue& rj_region_name = getMember(jsonValue, "region_name");
+				const RJValue& rj_continent_id = getMember(jsonValue, "continent_id");
+				const RJValue& rj_continent_name = getMember(jsonValue, "continent_name");
+				const RJValue& rj_map_rect = getMember(jsonValue, "map_rect");
+				const RJValue& rj_continent_rect = getMember(jsonValue, "continent_rect");
+
+				if (!rj_map_name.IsNull() && rj_map_name.IsString())				result->map_name = InternedString(rj_map_name.GetString(), rj_map_name.GetStringLength());
 				if (!rj_min_level.IsNull() && rj_min_level.IsInt())					result->min_level = rj_min_level.GetInt();
 				if (!rj_max_level.IsNull() && rj_max_level.IsInt())					result->max_level = rj_max_level.GetInt();
 				if (!rj_default_floor.IsNull() && rj_default_floor.IsInt())			result->default_floor = rj_default_floor.GetInt();
 				if (!rj_region_id.IsNull() && rj_region_id.IsInt())					result->region_id = rj_region_id.GetInt();
-				if (!rj_region_name.IsNull() && rj_region_name.IsString())			result->region_name = rj_region_name.GetString();
+				if (!rj_region_name.IsNull() && rj_region_name.IsString())			result->region_name = InternedString(rj_region_name.GetString(), rj_region_name.GetStringLength());
 				if (!rj_continent_id.IsNull() && rj_continent_id.IsInt())			result->continent_id = rj_continent_id.GetInt();
-				if (!rj_continent_name.IsNull() && rj_continent_name.IsString())	result->continent_name = rj_continent_name.GetString();
+				if (!rj_continent_name.IsNull() && rj_continent_name.IsString())	result->continent_name = InternedString(rj_continent_name.GetString(), rj_continent_name.GetStringLength());
 				bool success = true;
-				ArrayParser<int> arrayParserInt;
+				ArrayParser<int, A> arrayParserInt;
 				RectParser rectParser;
 				if (!rj_floors.IsNull())			success &= arrayParserInt.parse(rj_floors, &result->floors);
 				if (!rj_map_rect.IsNull())			success &= rectParser.parse(rj_map_rect, &result->map_rect);
@@ -351,32 +495,43 @@ namespace Gw2Api {
 				return success;
 			}
 		};
+		typedef BasicMapParser<HeapAllocator> MapParser;
 		typedef EntryDictionaryParser<int, MapEntry, MapParser> MapsParser;
 		
-		class MapsRootParser : public ApiResponseParser<MapsRootEntry> {
+		template<class A>
+		class BasicMapsRootParser : public ApiResponseParser<BasicMapsRootEntry<A> > {
 		public:
-			bool parse(const RJValue& jsonValue, MapsRootEntry* result) const {
-				if (jsonValue.IsNull() || !jsonValue.IsObject() || jsonValue["maps"].IsNull()) return false;
+			bool parse(const RJValue& jsonValue, BasicMapsRootEntry<A>* result) const {
+				if (jsonValue.IsNull() || !jsonValue.IsObject() || getMember(jsonValue, "maps").IsNull()) return false;
 				
-				const RJValue& rj_maps = jsonValue["maps"];
+				const RJValue& rj_maps = getMember(jsonValue, "maps");
 
 				bool success = true;
-				MapsParser mapsParser;
+				EntryDictionaryParser<int, BasicMapEntry<A>, BasicMapParser<A>, A> mapsParser;
 				if (!rj_maps.IsNull()) success &= mapsParser.parse(rj_maps, &result->maps);
 				return success;
 			}
 		};
+
+		class MapsRootParser : public ApiResponseParser<MapsRootEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, MapsRootEntry* result) const {
+				BasicMapsRootParser<HeapAllocator> parser;
+				return parser.parse(jsonValue, result);
+			}
+		};
+		typedef ArenaResponseParser<BasicMapsRootEntry<ResponseArenaAllocator>, BasicMapsRootParser<ResponseArenaAllocator> > ArenaMapsRootParser;
 		
 		class WorldNameParser : public ApiResponseParser<WorldNameEntry> {
 		public:
 			bool parse(const RJValue& jsonValue, WorldNameEntry* result) const {
 				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
 				
-				const RJValue& rj_id = jsonValue["id"];
-				const RJValue& rj_name = jsonValue["name"];
+				const RJValue& rj_id = getMember(jsonValue, "id");
+				const RJValue& rj_name = getMember(jsonValue, "name");
 
 				if (!rj_id.IsNull() && rj_id.IsString()) result->id = atoi(rj_id.GetString());
-				if (!rj_name.IsNull() && rj_name.IsString()) result->name = rj_name.GetString();
+				if (!rj_name.IsNull() && rj_name.IsString()) result->name = InternedString(rj_name.GetString(), rj_name.GetStringLength());
 				return true;
 			}
 		};
@@ -390,14 +545,186 @@ namespace Gw2Api {
 				WorldNamesParser worldNamesParser;
 				EntryCollection<WorldNameEntry> worldNameEntries;
 				if (worldNamesParser.parse(jsonValue, &worldNameEntries)) {
+					WorldNameEntries::Entries entries;
+					entries.reserve(worldNameEntries.size());
 					for (size_t i = 0; i < worldNameEntries.size(); i++) {
-						result->world_names[worldNameEntries[i].id] = worldNameEntries[i];
+						entries.push_back(WorldNameEntries::value_type(worldNameEntries[i].id, worldNameEntries[i]));
 					}
+					result->world_names.assign(entries);
 					return true;
 				}
 				return false;
 			}
 		};
+
+
+		/*
+		 * Parsers for the v2 API. Its lists are arrays or objects keyed by id with the id inside every entry, and some fields
+		 * have other names than in v1; the entries are parsed into the same objects as the v1 responses.
+		 */
+
+		// Adds the entries of an array to a dictionary, keyed by their "id" member; entries that are already in the dictionary are kept
+		template<class V, class P>
+		class IdArrayDictionaryParser : public ApiResponseParser<EntryDictionary<int, V> > {
+		public:
+			bool parse(const RJValue& jsonValue, EntryDictionary<int, V>* result) const {
+				if (jsonValue.IsNull() || !jsonValue.IsArray()) return false;
+
+				typename EntryDictionary<int, V>::Entries entries(result->begin(), result->end());
+				entries.reserve(entries.size() + jsonValue.Size());
+				P parser;
+				for (RJSizeType i = 0; i < jsonValue.Size(); i++) {
+					const RJValue& rj_id = getMember(jsonValue[i], "id");
+					if (rj_id.IsNull() || !rj_id.IsInt())
+						return false;
+					entries.push_back(typename EntryDictionary<int, V>::value_type(rj_id.GetInt(), V()));
+					if (!parser.parse(jsonValue[i], &entries.back().second))
+						return false;
+				}
+				result->assign(entries);
+				return true;
+			}
+		};
+
+		// Parses the values of an object keyed by id into a collection
+		template<class T, class P>
+		class IdObjectCollectionParser : public ApiResponseParser<EntryCollection<T> > {
+		public:
+			bool parse(const RJValue& jsonValue, EntryCollection<T>* result) const {
+				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
+
+				result->reserve(result->size() + (jsonValue.MemberEnd() - jsonValue.MemberBegin()));
+				P parser;
+				for (RJIterator i = jsonValue.MemberBegin(); i != jsonValue.MemberEnd(); i++) {
+					result->push_back(T());
+					if (!parser.parse(i->value, &result->back()))
+						return false;
+				}
+				return true;
+			}
+		};
+
+		class PointOfInterestV2Parser : public ApiResponseParser<PointOfInterestEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, PointOfInterestEntry* result) const {
+				PointOfInterestParser parser;
+				if (!parser.parse(jsonValue, result)) return false;
+
+				const RJValue& rj_id = getMember(jsonValue, "id");
+				if (!rj_id.IsNull() && rj_id.IsInt()) result->poi_id = rj_id.GetInt();
+				return true;
+			}
+		};
+
+		class TaskV2Parser : public ApiResponseParser<TaskEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, TaskEntry* result) const {
+				TaskParser parser;
+				if (!parser.parse(jsonValue, result)) return false;
+
+				const RJValue& rj_id = getMember(jsonValue, "id");
+				if (!rj_id.IsNull() && rj_id.IsInt()) result->task_id = rj_id.GetInt();
+				return true;
+			}
+		};
+
+		class SectorV2Parser : public ApiResponseParser<SectorEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, SectorEntry* result) const {
+				SectorParser parser;
+				if (!parser.parse(jsonValue, result)) return false;
+
+				const RJValue& rj_id = getMember(jsonValue, "id");
+				if (!rj_id.IsNull() && rj_id.IsInt()) result->sector_id = rj_id.GetInt();
+				return true;
+			}
+		};
+
+		class MapFloorV2Parser : public ApiResponseParser<MapFloorEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, MapFloorEntry* result) const {
+				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
+
+				const RJValue& rj_name = getMember(jsonValue, "name");
+				const RJValue& rj_min_level = getMember(jsonValue, "min_level");
+				const RJValue& rj_max_level = getMember(jsonValue, "max_level");
+				const RJValue& rj_default_floor = getMember(jsonValue, "default_floor");
+				const RJValue& rj_map_rect = getMember(jsonValue, "map_rect");
+				const RJValue& rj_continent_rect = getMember(jsonValue, "continent_rect");
+				const RJValue& rj_points_of_interest = getMember(jsonValue, "points_of_interest");
+				const RJValue& rj_tasks = getMember(jsonValue, "tasks");
+				const RJValue& rj_skill_challenges = getMember(jsonValue, "skill_challenges");
+				const RJValue& rj_sectors = getMember(jsonValue, "sectors");
+
+				if (!rj_name.IsNull() && rj_name.IsString())				result->name = InternedString(rj_name.GetString(), rj_name.GetStringLength());
+				if (!rj_min_level.IsNull() && rj_min_level.IsInt())			result->min_level = rj_min_level.GetInt();
+				if (!rj_max_level.IsNull() && rj_max_level.IsInt())			result->max_level = rj_max_level.GetInt();
+				if (!rj_default_floor.IsNull() && rj_default_floor.IsInt())	result->default_floor = rj_default_floor.GetInt();
+				bool success = true;
+				RectParser rectParser;
+				IdObjectCollectionParser<PointOfInterestEntry, PointOfInterestV2Parser> pointsOfInterestParser;
+				IdObjectCollectionParser<TaskEntry, TaskV2Parser> tasksParser;
+				SkillChallengesParser skillChallengesParser;
+				IdObjectCollectionParser<SectorEntry, SectorV2Parser> sectorsParser;
+				if (!rj_map_rect.IsNull())				success &= rectParser.parse(rj_map_rect, &result->map_rect);
+				if (!rj_continent_rect.IsNull())		success &= rectParser.parse(rj_continent_rect, &result->continent_rect);
+				if (!rj_points_of_interest.IsNull())	success &= pointsOfInterestParser.parse(rj_points_of_interest, &result->points_of_interest);
+				if (!rj_tasks.IsNull())					success &= tasksParser.parse(rj_tasks, &result->tasks);
+				if (!rj_skill_challenges.IsNull())		success &= skillChallengesParser.parse(rj_skill_challenges, &result->skill_challenges);
+				if (!rj_sectors.IsNull())				success &= sectorsParser.parse(rj_sectors, &result->sectors);
+				return success;
+			}
+		};
+
+		class ContinentMapsRootParser : public ApiResponseParser<ContinentMapsRootEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, ContinentMapsRootEntry* result) const {
+				IdArrayDictionaryParser<MapFloorEntry, MapFloorV2Parser> mapsParser;
+				return mapsParser.parse(jsonValue, &result->maps);
+			}
+		};
+
+		class MapV2Parser : public ApiResponseParser<MapEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, MapEntry* result) const {
+				MapParser parser;
+				if (!parser.parse(jsonValue, result)) return false;
+
+				const RJValue& rj_name = getMember(jsonValue, "name");
+				if (!rj_name.IsNull() && rj_name.IsString()) result->map_name = InternedString(rj_name.GetString(), rj_name.GetStringLength());
+				return true;
+			}
+		};
+
+		class MapsV2RootParser : public ApiResponseParser<MapsRootEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, MapsRootEntry* result) const {
+				IdArrayDictionaryParser<MapEntry, MapV2Parser> mapsParser;
+				return mapsParser.parse(jsonValue, &result->maps);
+			}
+		};
+
+		class WorldV2Parser : public ApiResponseParser<WorldNameEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, WorldNameEntry* result) const {
+				if (jsonValue.IsNull() || !jsonValue.IsObject()) return false;
+
+				const RJValue& rj_id = getMember(jsonValue, "id");
+				const RJValue& rj_name = getMember(jsonValue, "name");
+
+				if (!rj_id.IsNull() && rj_id.IsInt()) result->id = rj_id.GetInt();
+				if (!rj_name.IsNull() && rj_name.IsString()) result->name = InternedString(rj_name.GetString(), rj_name.GetStringLength());
+				return true;
+			}
+		};
+
+		class WorldsRootParser : public ApiResponseParser<WorldNamesRootEntry> {
+		public:
+			bool parse(const RJValue& jsonValue, WorldNamesRootEntry* result) const {
+				IdArrayDictionaryParser<WorldNameEntry, WorldV2Parser> worldsParser;
+				return worldsParser.parse(jsonValue, &result->world_names);
+			}
+		};
 	
 	}
 
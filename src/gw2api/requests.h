@@ -13,6 +13,7 @@
 #pragma once
 #include <map>
 #include <string>
+#include <vector>
 
 namespace Gw2Api {
 
@@ -21,6 +22,12 @@ namespace Gw2Api {
 		const std::string url_map_floor = "https://api.guildwars2.com/v1/map_floor.json";
 		const std::string url_maps = "https://api.guildwars2.com/v1/maps.json";
 		const std::string url_world_names = "https://api.guildwars2.com/v1/world_names.json";
+		const std::string url_v2_maps = "https://api.guildwars2.com/v2/maps";
+		const std::string url_v2_worlds = "https://api.guildwars2.com/v2/worlds";
+		const std::string url_v2_continents = "https://api.guildwars2.com/v2/continents";
+
+		// The v2 API doesn't return more entries per request, longer id lists have to be split up
+		const size_t maxIdsPerRequest = 200;
 
 		struct ApiRequest {
 			ApiRequest() { }
@@ -122,6 +129,68 @@ namespace Gw2Api {
 			}
 		};
 
+
+		// Base of the v2 requests that return the entries of a list of ids
+		struct IdsRequest : ApiRequest {
+			void setIDs(const int* ids, size_t count) {
+				if (count > 0) {
+					std::string list;
+					for (size_t i = 0; i < count; i++) {
+						if (i > 0)
+							list += ",";
+						list += std::to_string((long long)ids[i]);
+					}
+					parameters["ids"] = list;
+				} else {
+					parameters.erase("ids");
+				}
+			}
+
+			void setIDs(const std::vector<int>& ids) {
+				setIDs(ids.empty() ? NULL : &ids[0], ids.size());
+			}
+
+			void removeIDs() {
+				setIDs(NULL, 0);
+			}
+		};
+
+		struct MapsV2Request : IdsRequest {
+			MapsV2Request() {
+				this->url = url_v2_maps;
+			}
+
+			explicit MapsV2Request(const std::vector<int>& ids) {
+				this->url = url_v2_maps;
+				setIDs(ids);
+			}
+		};
+
+		struct WorldsRequest : IdsRequest {
+			WorldsRequest() {
+				this->url = url_v2_worlds;
+			}
+
+			explicit WorldsRequest(const std::vector<int>& ids) {
+				this->url = url_v2_worlds;
+				setIDs(ids);
+			}
+		};
+
+		// The maps of a region on a continent floor, like they are listed in a map floor response
+		struct ContinentMapsRequest : IdsRequest {
+			ContinentMapsRequest(const int continent_id, const int floor, const int region_id) {
+				this->url = url_v2_continents + "/" + std::to_string((long long)continent_id) + "/floors/" + std::to_string((long long)floor) +
+					"/regions/" + std::to_string((long long)region_id) + "/maps";
+			}
+
+			ContinentMapsRequest(const int continent_id, const int floor, const int region_id, const std::vector<int>& ids) {
+				this->url = url_v2_continents + "/" + std::to_string((long long)continent_id) + "/floors/" + std::to_string((long long)floor) +
+					"/regions/" + std::to_string((long long)region_id) + "/maps";
+				setIDs(ids);
+			}
+		};
+
 	}
 
 }
@@ -0,0 +1,87 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#include <deque>
+#include <unordered_set>
+#include <Windows.h>
+#include "stringpool.h"
+using namespace std;
+
+namespace Gw2Api {
+
+	// Strings are looked up with the lock held shared and only inserted exclusively, most names are already pooled
+	class StringPool {
+	private:
+		// Refers to the characters of a pooled string, or to the looked up characters, so lookups don't have to copy them first
+		struct Key {
+			const char* data;
+			size_t length;
+			const string* value; // NULL for lookup keys
+		};
+		struct KeyHash {
+			size_t operator()(const Key& key) const {
+				// FNV-1a
+				size_t hash = (size_t)2166136261U;
+				for (size_t i = 0; i < key.length; i++)
+					hash = (hash ^ (unsigned char)key.data[i]) * (size_t)16777619U;
+				return hash;
+			}
+		};
+		struct KeyEqual {
+			bool operator()(const Key& lhs, const Key& rhs) const {
+				return lhs.length == rhs.length && memcmp(lhs.data, rhs.data, lhs.length) == 0;
+			}
+		};
+
+		deque<string> strings; // Appending never moves the elements, so pointers to them stay valid
+		unordered_set<Key, KeyHash, KeyEqual> index;
+		SRWLOCK lock;
+
+		const string* find(const Key& key) const {
+			unordered_set<Key, KeyHash, KeyEqual>::const_iterator it = index.find(key);
+			return it != index.end() ? it->value : NULL;
+		}
+
+	public:
+		StringPool() { InitializeSRWLock(&lock); }
+
+		const string* intern(const char* value, size_t length) {
+			Key key = { value, length, NULL };
+
+			AcquireSRWLockShared(&lock);
+			const string* result = find(key);
+			ReleaseSRWLockShared(&lock);
+			if (result != NULL)
+				return result;
+
+			AcquireSRWLockExclusive(&lock);
+			// Another thread may have inserted it in the meantime
+			result = find(key);
+			if (result == NULL) {
+				strings.push_back(string(value, length));
+				result = &strings.back();
+				Key pooledKey = { result->data(), result->length(), result };
+				index.insert(pooledKey);
+			}
+			ReleaseSRWLockExclusive(&lock);
+			return result;
+		}
+	};
+
+	// Only non-empty strings are pooled, so nothing uses the pool before it's constructed during static initialization
+	static StringPool stringPool;
+
+	const string* internString(const char* value, size_t length) {
+		return stringPool.intern(value, length);
+	}
+
+}
@@ -0,0 +1,70 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <string.h>
+#include <memory>
+#include <string>
+
+namespace Gw2Api {
+
+	// Returns the pooled copy of a string, equal strings always return the same copy; pooled strings are never freed
+	const std::string* internString(const char* value, size_t length);
+
+	// Immutable handle to a pooled string, for names that are repeated across many records (maps, regions, continents, worlds).
+	// Copying a handle doesn't copy the string and comparing pooled handles only compares pointers.
+	// Strings that don't come from the API (e.g. received from other clients) aren't pooled, because the pool is never freed.
+	class InternedString {
+	private:
+		const std::string* value; // NULL for the empty string, so default handles never touch the pool
+		std::shared_ptr<const std::string> owned; // Only set for unpooled strings
+
+		void set(const char* value, size_t length) {
+			this->value = length > 0 ? internString(value, length) : NULL;
+		}
+
+	public:
+		InternedString() { value = NULL; }
+		InternedString(const char* value) { set(value, strlen(value)); }
+		InternedString(const char* value, size_t length) { set(value, length); }
+		InternedString(const std::string& value) { set(value.c_str(), value.length()); }
+
+		// Returns a handle that owns its own copy of the string instead of pooling it
+		static InternedString unpooled(const char* value, size_t length) {
+			InternedString result;
+			if (length > 0) {
+				result.owned = std::shared_ptr<const std::string>(new std::string(value, length));
+				result.value = result.owned.get();
+			}
+			return result;
+		}
+		static InternedString unpooled(const std::string& value) { return unpooled(value.c_str(), value.length()); }
+
+		const char* c_str() const { return value != NULL ? value->c_str() : ""; }
+		size_t length() const { return value != NULL ? value->length() : 0; }
+		bool empty() const { return value == NULL; }
+		std::string str() const { return value != NULL ? *value : std::string(); }
+
+		bool operator==(const InternedString& other) const {
+			if (value == other.value)
+				return true;
+			// Equal pooled strings share the same copy, only unpooled strings have to be compared by content
+			return (owned || other.owned) && length() == other.length() && memcmp(c_str(), other.c_str(), length()) == 0;
+		}
+		bool operator!=(const InternedString& other) const { return !(*this == other); }
+	};
+
+	inline std::string operator+(const std::string& lhs, const InternedString& rhs) { return lhs + rhs.c_str(); }
+	inline std::string operator+(const InternedString& lhs, const std::string& rhs) { return lhs.c_str() + rhs; }
+	inline std::string operator+(const InternedString& lhs, const char* rhs) { return lhs.str() + rhs; }
+
+}
@@ -10,12 +10,18 @@
  * GNU General Public License for more details.
 */
 
+#include <limits.h>
+#include <string.h>
 #include "plugin_definitions.h"
-#include "rapidjson/document.h"
+#include "rapidjson/reader.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/writer.h"
+#include "gw2api/base64.h"
 #include "gw2api/chat.h"
+#include "gw2api/gw2api.h"
 #include "gw2info.h"
+#include "gw2mathutils.h"
+#include "stringutils.h"
 using namespace std;
 using namespace Gw2Api;
 using namespace Gw2Api::ChatLink;
@@ -28,99 +34,638 @@ using namespace Gw2Api::MumbleLink;
 #endif
 
 
-Gw2Info::Gw2Info(string jsonString) {
-	rapidjson::Document json;
-	if (!json.Parse<0>(jsonString.c_str()).HasParseError()) {
-		const rapidjson::Value& rj_character_name = json["character_name"];
-		const rapidjson::Value& rj_profession = json["profession"];
-		const rapidjson::Value& rj_character_continent_position = json["character_continent_position"];
-		const rapidjson::Value& rj_map_id = json["map_id"];
-		const rapidjson::Value& rj_map_name = json["map_name"];
-		const rapidjson::Value& rj_region_id = json["region_id"];
-		const rapidjson::Value& rj_region_name = json["region_name"];
-		const rapidjson::Value& rj_continent_id = json["continent_id"];
-		const rapidjson::Value& rj_continent_name = json["continent_name"];
-		const rapidjson::Value& rj_world_id = json["world_id"];
-		const rapidjson::Value& rj_world_name = json["world_name"];
-		const rapidjson::Value& rj_waypoint_id = json["waypoint_id"];
-		const rapidjson::Value& rj_waypoint_name = json["waypoint_name"];
-		const rapidjson::Value& rj_waypoint_continent_position = json["waypoint_continent_position"];
-		const rapidjson::Value& rj_team_color_id = json["team_color_id"];
-		const rapidjson::Value& rj_commander = json["commander"];
-		const rapidjson::Value& rj_plugin_version = json["plugin_version"];
-
-		if (!rj_character_name.IsNull() && rj_character_name.IsString())		characterName = rj_character_name.GetString();
-		if (!rj_profession.IsNull() && rj_profession.IsInt())					profession = (Profession)rj_profession.GetInt();
-		if (!rj_character_continent_position.IsNull() && rj_character_continent_position.IsArray()) {
-			characterContinentPosition = Vector3D(
-				rj_character_continent_position[0u].GetDouble(),
-				rj_character_continent_position[1].GetDouble(),
-				rj_character_continent_position[2].GetDouble()
-			);
+enum Gw2InfoJsonField {
+	JSONFIELD_NONE = -1,
+	JSONFIELD_CHARACTER_NAME,
+	JSONFIELD_PROFESSION,
+	JSONFIELD_CHARACTER_CONTINENT_POSITION,
+	JSONFIELD_MAP_ID,
+	JSONFIELD_MAP_NAME,
+	JSONFIELD_MAP_SHARD_ID,
+	JSONFIELD_MAP_INSTANCE,
+	JSONFIELD_REGION_ID,
+	JSONFIELD_REGION_NAME,
+	JSONFIELD_CONTINENT_ID,
+	JSONFIELD_CONTINENT_NAME,
+	JSONFIELD_WORLD_ID,
+	JSONFIELD_WORLD_NAME,
+	JSONFIELD_WAYPOINT_ID,
+	JSONFIELD_WAYPOINT_NAME,
+	JSONFIELD_WAYPOINT_CONTINENT_POSITION,
+	JSONFIELD_TEAM_COLOR_ID,
+	JSONFIELD_COMMANDER,
+	JSONFIELD_PLUGIN_VERSION
+};
+
+struct Gw2InfoJsonKey {
+	const char* name;
+	Gw2InfoJsonField field;
+};
+
+// Indexed by getJsonKeyHash, which has no collisions for these keys; empty slots have no name
+static const Gw2InfoJsonKey jsonKeys[32] = {
+	{ "profession", JSONFIELD_PROFESSION },
+	{ "map_name", JSONFIELD_MAP_NAME },
+	{ NULL, JSONFIELD_NONE },
+	{ "waypoint_id", JSONFIELD_WAYPOINT_ID },
+	{ "map_shard_id", JSONFIELD_MAP_SHARD_ID },
+	{ "map_instance", JSONFIELD_MAP_INSTANCE },
+	{ "waypoint_name", JSONFIELD_WAYPOINT_NAME },
+	{ "commander", JSONFIELD_COMMANDER },
+	{ NULL, JSONFIELD_NONE },
+	{ NULL, JSONFIELD_NONE },
+	{ "character_continent_position", JSONFIELD_CHARACTER_CONTINENT_POSITION },
+	{ NULL, JSONFIELD_NONE },
+	{ "plugin_version", JSONFIELD_PLUGIN_VERSION },
+	{ NULL, JSONFIELD_NONE },
+	{ NULL, JSONFIELD_NONE },
+	{ NULL, JSONFIELD_NONE },
+	{ NULL, JSONFIELD_NONE },
+	{ "region_id", JSONFIELD_REGION_ID },
+	{ NULL, JSONFIELD_NONE },
+	{ "character_name", JSONFIELD_CHARACTER_NAME },
+	{ "region_name", JSONFIELD_REGION_NAME },
+	{ "team_color_id", JSONFIELD_TEAM_COLOR_ID },
+	{ NULL, JSONFIELD_NONE },
+	{ NULL, JSONFIELD_NONE },
+	{ "world_id", JSONFIELD_WORLD_ID },
+	{ NULL, JSONFIELD_NONE },
+	{ NULL, JSONFIELD_NONE },
+	{ "world_name", JSONFIELD_WORLD_NAME },
+	{ "continent_id", JSONFIELD_CONTINENT_ID },
+	{ "waypoint_continent_position", JSONFIELD_WAYPOINT_CONTINENT_POSITION },
+	{ "map_id", JSONFIELD_MAP_ID },
+	{ "continent_name", JSONFIELD_CONTINENT_NAME }
+};
+
+static inline unsigned int getJsonKeyHash(const char* key, size_t length) {
+	return (unsigned int)(length + 20 * (unsigned char)key[1] + (unsigned char)key[length - 1]) & 31;
+}
+
+static Gw2InfoJsonField findJsonField(const char* key, size_t length) {
+	if (length < 2)
+		return JSONFIELD_NONE;
+	const Gw2InfoJsonKey& entry = jsonKeys[getJsonKeyHash(key, length)];
+	if (entry.name == NULL || strncmp(entry.name, key, length) != 0 || entry.name[length] != '\0')
+		return JSONFIELD_NONE;
+	return entry.field;
+}
+
+/*
+ * SAX handler that writes the members of the root object straight into a record. Members of an unexpected type are ignored,
+ * like they were when the command was parsed into a document, and so is anything nested deeper than the position arrays.
+ */
+class Gw2InfoJsonHandler {
+private:
+	Gw2Info& info;
+	int depth;
+	bool rootIsObject;
+	bool expectingKey;
+	Gw2InfoJsonField field;
+	bool valueIsArray; // Whether the value at depth 2 is an array, values inside nested objects are ignored
+	unsigned int arrayIndex;
+	// Names of the record before it was cleared, received names that didn't change keep them instead of allocating new copies
+	InternedString previousMapName;
+	InternedString previousRegionName;
+	InternedString previousContinentName;
+	InternedString previousWorldName;
+
+	static InternedString keepOrCopy(const InternedString& previous, const char* value, rapidjson::SizeType length) {
+		if (previous.length() == length && memcmp(previous.c_str(), value, length) == 0)
+			return previous;
+		return InternedString::unpooled(value, length);
+	}
+
+	void nextKey() {
+		if (depth == 1)
+			expectingKey = true;
+	}
+
+	void setInteger(int64_t value) {
+		if (depth == 2) {
+			if (valueIsArray)
+				setArrayElement((double)value);
+			return;
 		}
-		if (!rj_map_id.IsNull() && rj_map_id.IsInt())							mapId = rj_map_id.GetInt();
-		if (!rj_map_name.IsNull() && rj_map_name.IsString())					mapName = rj_map_name.GetString();
-		if (!rj_region_id.IsNull() && rj_region_id.IsInt())						regionId = rj_region_id.GetInt();
-		if (!rj_region_name.IsNull() && rj_region_name.IsString())				regionName = rj_region_name.GetString();
-		if (!rj_continent_id.IsNull() && rj_continent_id.IsInt())				continentId = rj_continent_id.GetInt();
-		if (!rj_continent_name.IsNull() && rj_continent_name.IsString())		continentName = rj_continent_name.GetString();
-		if (!rj_world_id.IsNull() && rj_world_id.IsInt())						worldId = rj_world_id.GetInt();
-		if (!rj_world_name.IsNull() && rj_world_name.IsString())				worldName = rj_world_name.GetString();
-		if (!rj_waypoint_id.IsNull() && rj_waypoint_id.IsInt())					waypointId = rj_waypoint_id.GetInt();
-		if (!rj_waypoint_name.IsNull() && rj_waypoint_name.IsString())			waypointName = rj_waypoint_name.GetString();
-		if (!rj_waypoint_continent_position.IsNull() && rj_waypoint_continent_position.IsArray()) {
-			waypointContinentPosition = Vector2D(
-				rj_waypoint_continent_position[0u].GetDouble(),
-				rj_waypoint_continent_position[1].GetDouble()
-			);
+		if (depth != 1)
+			return;
+
+		bool isInt = value >= INT_MIN && value <= INT_MAX;
+		bool isUint = value >= 0 && value <= UINT_MAX;
+		switch (field) {
+			case JSONFIELD_PROFESSION:		if (isInt) info.profession = (Profession)value; break;
+			case JSONFIELD_MAP_ID:			if (isInt) info.mapId = (uint32_t)value; break;
+			case JSONFIELD_MAP_SHARD_ID:	if (isUint) info.mapShardId = (uint32_t)value; break;
+			case JSONFIELD_MAP_INSTANCE:	if (isUint) info.mapInstance = (uint32_t)value; break;
+			case JSONFIELD_REGION_ID:		if (isInt) info.regionId = (uint32_t)value; break;
+			case JSONFIELD_CONTINENT_ID:	if (isInt) info.continentId = (uint32_t)value; break;
+			case JSONFIELD_WORLD_ID:		if (isInt) info.worldId = (uint32_t)value; break;
+			case JSONFIELD_WAYPOINT_ID:		if (isInt) info.waypointId = (uint32_t)value; break;
+			case JSONFIELD_TEAM_COLOR_ID:	if (isInt) info.teamColorId = (uint32_t)value; break;
+			default: break;
+		}
+		nextKey();
+	}
+
+	void setArrayElement(double value) {
+		unsigned int index = arrayIndex++;
+		if (field == JSONFIELD_CHARACTER_CONTINENT_POSITION) {
+			if (index == 0)			info.characterContinentPosition.x = value;
+			else if (index == 1)	info.characterContinentPosition.y = value;
+			else if (index == 2)	info.characterContinentPosition.z = value;
+		} else if (field == JSONFIELD_WAYPOINT_CONTINENT_POSITION) {
+			if (index == 0)			info.waypointContinentPosition.x = value;
+			else if (index == 1)	info.waypointContinentPosition.y = value;
 		}
-		if (!rj_team_color_id.IsNull() && rj_team_color_id.IsString())			teamColorId = rj_team_color_id.GetInt();
-		if (!rj_commander.IsNull() && rj_commander.IsBool())					commander = rj_commander.GetBool();
-		if (!rj_plugin_version.IsNull() && rj_plugin_version.IsString())		pluginVersion = rj_plugin_version.GetString();
 	}
+
+public:
+	typedef char Ch;
+
+	Gw2InfoJsonHandler(Gw2Info& info) : info(info), previousMapName(info.mapName), previousRegionName(info.regionName),
+		previousContinentName(info.continentName), previousWorldName(info.worldName) {
+		depth = 0;
+		rootIsObject = false;
+		expectingKey = false;
+		field = JSONFIELD_NONE;
+		valueIsArray = false;
+		arrayIndex = 0;
+	}
+
+	bool isRootObject() const { return rootIsObject; }
+
+	void Null() { nextKey(); }
+
+	void Bool(bool value) {
+		if (depth == 1 && field == JSONFIELD_COMMANDER)
+			info.commander = value;
+		nextKey();
+	}
+
+	void Int(int value) { setInteger(value); }
+	void Uint(unsigned value) { setInteger(value); }
+	void Int64(int64_t value) { setInteger(value); }
+	void Uint64(uint64_t value) { if (value <= INT64_MAX) setInteger((int64_t)value); else nextKey(); }
+
+	void Double(double value) {
+		if (depth == 2 && valueIsArray)
+			setArrayElement(value);
+		nextKey();
+	}
+
+	void String(const char* value, rapidjson::SizeType length, bool) {
+		if (depth == 1 && expectingKey) {
+			field = findJsonField(value, length);
+			expectingKey = false;
+			return;
+		}
+		if (depth == 1) {
+			switch (field) {
+				case JSONFIELD_CHARACTER_NAME:	info.characterName.assign(value, length); break;
+				case JSONFIELD_MAP_NAME:		info.mapName = keepOrCopy(previousMapName, value, length); break;
+				case JSONFIELD_REGION_NAME:		info.regionName = keepOrCopy(previousRegionName, value, length); break;
+				case JSONFIELD_CONTINENT_NAME:	info.continentName = keepOrCopy(previousContinentName, value, length); break;
+				case JSONFIELD_WORLD_NAME:		info.worldName = keepOrCopy(previousWorldName, value, length); break;
+				case JSONFIELD_WAYPOINT_NAME:	info.waypointName.assign(value, length); break;
+				case JSONFIELD_PLUGIN_VERSION:	info.pluginVersion.assign(value, length); break;
+				default: break;
+			}
+		}
+		nextKey();
+	}
+
+	void StartObject() {
+		if (depth == 0)
+			rootIsObject = true;
+		depth++;
+		if (depth == 2)
+			valueIsArray = false;
+		nextKey();
+	}
+
+	void EndObject(rapidjson::SizeType) {
+		depth--;
+		nextKey();
+	}
+
+	void StartArray() {
+		depth++;
+		if (depth == 2) {
+			valueIsArray = true;
+			arrayIndex = 0;
+		}
+	}
+
+	void EndArray(rapidjson::SizeType) {
+		depth--;
+		nextKey();
+	}
+};
+
+Gw2Info::Gw2Info(const char* json) {
+	Gw2InfoJsonParser parser;
+	parser.parse(json, *this);
 }
 
-string Gw2Info::toJson() const {
-	rapidjson::Document json;
-	json.Parse<0>("{}");
-	json.AddMember("character_name", characterName.c_str(), json.GetAllocator());
-	json.AddMember("profession", profession, json.GetAllocator());
-	json.AddMember("character_continent_position", "[]", json.GetAllocator());
-	json["character_continent_position"].SetArray();
-	json["character_continent_position"].PushBack(characterContinentPosition.x, json.GetAllocator());
-	json["character_continent_position"].PushBack(characterContinentPosition.y, json.GetAllocator());
-	json["character_continent_position"].PushBack(characterContinentPosition.z, json.GetAllocator());
-	json.AddMember("map_id", mapId, json.GetAllocator());
-	json.AddMember("map_name", mapName.c_str(), json.GetAllocator());
-	json.AddMember("region_id", regionId, json.GetAllocator());
-	json.AddMember("region_name", regionName.c_str(), json.GetAllocator());
-	json.AddMember("continent_id", continentId, json.GetAllocator());
-	json.AddMember("continent_name", continentName.c_str(), json.GetAllocator());
-	json.AddMember("world_id", worldId, json.GetAllocator());
-	json.AddMember("world_name", worldName.c_str(), json.GetAllocator());
-	json.AddMember("waypoint_id", waypointId, json.GetAllocator());
-	json.AddMember("waypoint_name", waypointName.c_str(), json.GetAllocator());
-	json.AddMember("waypoint_continent_position", "[]", json.GetAllocator());
-	json["waypoint_continent_position"].SetArray();
-	json["waypoint_continent_position"].PushBack(waypointContinentPosition.x, json.GetAllocator());
-	json["waypoint_continent_position"].PushBack(waypointContinentPosition.y, json.GetAllocator());
-	json.AddMember("team_color_id", teamColorId, json.GetAllocator());
-	json.AddMember("commander", commander, json.GetAllocator());
-	json.AddMember("plugin_version", pluginVersion.c_str(), json.GetAllocator());
+bool Gw2InfoJsonParser::parse(const char* json, Gw2Info& info) {
+	// The handler takes over the current names first, so parsing an update into the existing record doesn't allocate them again
+	Gw2InfoJsonHandler handler(info);
+	info.clear();
+	rapidjson::StringStream stream(json);
+	if (!reader.Parse<0>(stream, handler) || !handler.isRootObject()) {
+		info.clear();
+		return false;
+	}
+	return true;
+}
 
+string Gw2Info::toJson() const {
 	rapidjson::StringBuffer buffer;
 	rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-	json.Accept(writer);
-	return buffer.GetString();
+	toJson(writer);
+	return string(buffer.GetString(), buffer.Size());
+}
+
+static void writeJsonString(rapidjson::Writer<rapidjson::StringBuffer>& writer, const string& value) {
+	writer.String(value.c_str(), (rapidjson::SizeType)value.length());
+}
+
+static void writeJsonString(rapidjson::Writer<rapidjson::StringBuffer>& writer, const InternedString& value) {
+	writer.String(value.c_str(), (rapidjson::SizeType)value.length());
+}
+
+void Gw2Info::toJson(rapidjson::Writer<rapidjson::StringBuffer>& writer) const {
+	// Member order and number formatting have to stay the same as in previous plugin versions
+	writer.StartObject();
+	writer.String("character_name");			writeJsonString(writer, characterName);
+	writer.String("profession");				writer.Int(profession);
+	writer.String("character_continent_position");
+	writer.StartArray();
+	writer.Double(characterContinentPosition.x);
+	writer.Double(characterContinentPosition.y);
+	writer.Double(characterContinentPosition.z);
+	writer.EndArray();
+	writer.String("map_id");					writer.Uint(mapId);
+	writer.String("map_name");					writeJsonString(writer, mapName);
+	writer.String("map_shard_id");				writer.Uint(mapShardId);
+	writer.String("map_instance");				writer.Uint(mapInstance);
+	writer.String("region_id");					writer.Uint(regionId);
+	writer.String("region_name");				writeJsonString(writer, regionName);
+	writer.String("continent_id");				writer.Uint(continentId);
+	writer.String("continent_name");			writeJsonString(writer, continentName);
+	writer.String("world_id");					writer.Uint(worldId);
+	writer.String("world_name");				writeJsonString(writer, worldName);
+	writer.String("waypoint_id");				writer.Uint(waypointId);
+	writer.String("waypoint_name");				writeJsonString(writer, waypointName);
+	writer.String("waypoint_continent_position");
+	writer.StartArray();
+	writer.Double(waypointContinentPosition.x);
+	writer.Double(waypointContinentPosition.y);
+	writer.EndArray();
+	writer.String("team_color_id");				writer.Uint(teamColorId);
+	writer.String("commander");					writer.Bool(commander);
+	writer.String("plugin_version");			writeJsonString(writer, pluginVersion);
+	writer.EndObject();
+}
+
+
+static void writeVarUint(vector<unsigned char>& buffer, uint32_t value) {
+	while (value >= 0x80) {
+		buffer.push_back((unsigned char)(value | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back((unsigned char)value);
+}
+
+static int32_t roundCoordinate(double value) {
+	return (int32_t)floor(value + 0.5);
+}
+
+static void writeVarInt(vector<unsigned char>& buffer, double value) {
+	int32_t rounded = roundCoordinate(value);
+	writeVarUint(buffer, ((uint32_t)rounded << 1) ^ (uint32_t)(rounded >> 31)); // Zigzag encoding keeps small negative numbers small
+}
+
+static void writeString(vector<unsigned char>& buffer, const string& value) {
+	writeVarUint(buffer, (uint32_t)value.length());
+	buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+static bool readVarUint(const vector<unsigned char>& buffer, size_t& pos, uint32_t& value) {
+	value = 0;
+	for (int shift = 0; shift < 35 && pos < buffer.size(); shift += 7) {
+		unsigned char b = buffer[pos++];
+		value |= (uint32_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool readVarInt(const vector<unsigned char>& buffer, size_t& pos, double& value) {
+	uint32_t zigzag;
+	if (!readVarUint(buffer, pos, zigzag))
+		return false;
+	value = (double)((int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1));
+	return true;
+}
+
+static bool readString(const vector<unsigned char>& buffer, size_t& pos, string& value) {
+	uint32_t length;
+	if (!readVarUint(buffer, pos, length) || length > buffer.size() - pos)
+		return false;
+	value.assign(buffer.begin() + pos, buffer.begin() + pos + length);
+	pos += length;
+	return true;
+}
+
+int Gw2Info::getChangedFields(const Gw2Info& other) const {
+	int fields = 0;
+	if (characterName != other.characterName || profession != other.profession || commander != other.commander || teamColorId != other.teamColorId)
+		fields |= GW2INFO_FIELD_CHARACTER;
+	if (mapId != other.mapId || worldId != other.worldId)
+		fields |= GW2INFO_FIELD_MAP;
+	if (mapShardId != other.mapShardId || mapInstance != other.mapInstance)
+		fields |= GW2INFO_FIELD_INSTANCE;
+	if (roundCoordinate(characterContinentPosition.x) != roundCoordinate(other.characterContinentPosition.x) ||
+		roundCoordinate(characterContinentPosition.y) != roundCoordinate(other.characterContinentPosition.y) ||
+		roundCoordinate(characterContinentPosition.z) != roundCoordinate(other.characterContinentPosition.z))
+		fields |= GW2INFO_FIELD_POSITION;
+	if (waypointId != other.waypointId)
+		fields |= GW2INFO_FIELD_WAYPOINT;
+	if (pluginVersion != other.pluginVersion)
+		fields |= GW2INFO_FIELD_PLUGINVERSION;
+	return fields;
+}
+
+/*
+ * Compact layout: uint8 version, varint field mask, varint sequence number, followed by the field groups in the mask:
+ *   GW2INFO_FIELD_CHARACTER:     uint8 flags (1 = commander), varint profession, character name (length + UTF-8), varint team color id
+ *   GW2INFO_FIELD_MAP:           varint map id, varint world id
+ *   GW2INFO_FIELD_INSTANCE:      varint shard id, varint instance
+ *   GW2INFO_FIELD_POSITION:      zigzag varints of the character continent position rounded to whole units (x, y, z)
+ *   GW2INFO_FIELD_WAYPOINT:      varint waypoint id
+ *   GW2INFO_FIELD_PLUGINVERSION: plugin version (length + UTF-8)
+ * The whole buffer is base64 encoded.
+ */
+string Gw2Info::toCompact(uint32_t sequence, int fields) const {
+	if (fields & GW2INFO_FIELD_WAYPOINT)
+		fields |= GW2INFO_FIELD_MAP;
+
+	vector<unsigned char> buffer;
+	buffer.reserve(64);
+	buffer.push_back(GW2INFO_COMPACT_VERSION);
+	writeVarUint(buffer, fields);
+	writeVarUint(buffer, sequence);
+	if (fields & GW2INFO_FIELD_CHARACTER) {
+		buffer.push_back(commander ? 1 : 0);
+		writeVarUint(buffer, profession);
+		writeString(buffer, characterName);
+		writeVarUint(buffer, teamColorId);
+	}
+	if (fields & GW2INFO_FIELD_MAP) {
+		writeVarUint(buffer, mapId);
+		writeVarUint(buffer, worldId);
+	}
+	if (fields & GW2INFO_FIELD_INSTANCE) {
+		writeVarUint(buffer, mapShardId);
+		writeVarUint(buffer, mapInstance);
+	}
+	if (fields & GW2INFO_FIELD_POSITION) {
+		writeVarInt(buffer, characterContinentPosition.x);
+		writeVarInt(buffer, characterContinentPosition.y);
+		writeVarInt(buffer, characterContinentPosition.z);
+	}
+	if (fields & GW2INFO_FIELD_WAYPOINT)
+		writeVarUint(buffer, waypointId);
+	if (fields & GW2INFO_FIELD_PLUGINVERSION)
+		writeString(buffer, pluginVersion);
+	return base64Encode(buffer);
+}
+
+void Gw2Info::copyFields(const Gw2Info& other, int fields) {
+	if (fields & GW2INFO_FIELD_CHARACTER) {
+		characterName = other.characterName;
+		profession = other.profession;
+		commander = other.commander;
+		teamColorId = other.teamColorId;
+	}
+	if (fields & GW2INFO_FIELD_MAP) {
+		mapId = other.mapId;
+		mapName = other.mapName;
+		regionId = other.regionId;
+		regionName = other.regionName;
+		continentId = other.continentId;
+		continentName = other.continentName;
+		worldId = other.worldId;
+		worldName = other.worldName;
+	}
+	if (fields & GW2INFO_FIELD_INSTANCE) {
+		mapShardId = other.mapShardId;
+		mapInstance = other.mapInstance;
+	}
+	if (fields & GW2INFO_FIELD_POSITION)
+		characterContinentPosition = other.characterContinentPosition;
+	if (fields & GW2INFO_FIELD_WAYPOINT) {
+		waypointId = other.waypointId;
+		waypointName = other.waypointName;
+		waypointContinentPosition = other.waypointContinentPosition;
+	}
+	if (fields & GW2INFO_FIELD_PLUGINVERSION)
+		pluginVersion = other.pluginVersion;
+}
+
+void Gw2Info::resolveMapNames() {
+	ApiInnerResponseObject<MapsRootEntry, MapEntry> map;
+	if (getMap(mapId, &map)) {
+		mapName = map.value.map_name;
+		regionId = map.value.region_id;
+		regionName = map.value.region_name;
+		continentId = map.value.continent_id;
+		continentName = map.value.continent_name;
+	} else {
+		mapName = InternedString::unpooled("Map " + to_string(mapId));
+		regionId = 0;
+		regionName = "Unknown region";
+		continentId = 0;
+		continentName = "Unknown continent";
+	}
+
+	WorldNamesRootEntry worldNames;
+	WorldNameEntries::const_iterator world;
+	if (getWorldNames(&worldNames) && (world = worldNames.world_names.find(worldId)) != worldNames.world_names.end()) {
+		worldName = world->second.name;
+	} else {
+		worldName = InternedString::unpooled("World " + to_string(worldId));
+	}
+}
+
+void Gw2Info::setPlaceholderNames(int fields) {
+	if (fields & GW2INFO_FIELD_MAP) {
+		mapName = InternedString::unpooled("Map " + to_string(mapId));
+		regionId = 0;
+		regionName = "Unknown region";
+		continentId = 0;
+		continentName = "Unknown continent";
+		worldName = InternedString::unpooled("World " + to_string(worldId));
+	}
+	if (fields & GW2INFO_FIELD_WAYPOINT) {
+		waypointName = waypointId > 0 ? "Waypoint " + to_string(waypointId) : "";
+		waypointContinentPosition = Vector2D();
+	}
+}
+
+
+bool Gw2NameIndex::isRetryDue(FailedIds& failedIds, uint64_t id, time_t now) {
+	FailedIds::iterator it = failedIds.find(id);
+	if (it == failedIds.end())
+		return true;
+	if (difftime(now, it->second) < GW2NAMEINDEX_RETRY_DELAY)
+		return false;
+	failedIds.erase(it);
+	return true;
+}
+
+void Gw2NameIndex::rememberFailure(FailedIds& failedIds, uint64_t id, time_t now) {
+	if (failedIds.size() >= GW2NAMEINDEX_MAX_FAILED_IDS) {
+		for (FailedIds::iterator it = failedIds.begin(); it != failedIds.end();) {
+			if (difftime(now, it->second) >= GW2NAMEINDEX_RETRY_DELAY)
+				it = failedIds.erase(it);
+			else
+				++it;
+		}
+		// Only happens when a lot of made up ids are received, retrying them a bit earlier doesn't hurt
+		if (failedIds.size() >= GW2NAMEINDEX_MAX_FAILED_IDS)
+			failedIds.clear();
+	}
+	failedIds[id] = now;
+}
+
+void Gw2NameIndex::prefetch(const vector<int>& mapIds, const vector<int>& worldIds) {
+	time_t now = time(NULL);
+
+	vector<int> unknownMapIds;
+	for (size_t i = 0; i < mapIds.size(); i++) {
+		if (mapIds[i] > 0 && maps.find(mapIds[i]) == maps.end() && isRetryDue(failedMaps, mapIds[i], now))
+			unknownMapIds.push_back(mapIds[i]);
+	}
+	if (!unknownMapIds.empty()) {
+		// Partial results are kept, the missing ids are only tried again after the retry delay
+		MapsRootEntry mapsRoot;
+		getMapsByIDs(unknownMapIds, &mapsRoot);
+		for (MapEntries::const_iterator it = mapsRoot.maps.begin(); it != mapsRoot.maps.end(); it++) {
+			MapNames& names = maps[it->first];
+			names.mapName = it->second.map_name;
+			names.regionId = it->second.region_id;
+			names.regionName = it->second.region_name;
+			names.continentId = it->second.continent_id;
+			names.continentName = it->second.continent_name;
+		}
+		for (size_t i = 0; i < unknownMapIds.size(); i++) {
+			if (maps.find(unknownMapIds[i]) == maps.end())
+				rememberFailure(failedMaps, unknownMapIds[i], now);
+		}
+	}
+
+	vector<int> unknownWorldIds;
+	for (size_t i = 0; i < worldIds.size(); i++) {
+		if (worldIds[i] > 0 && worlds.find(worldIds[i]) == worlds.end() && isRetryDue(failedWorlds, worldIds[i], now))
+			unknownWorldIds.push_back(worldIds[i]);
+	}
+	if (!unknownWorldIds.empty()) {
+		WorldNamesRootEntry worldsRoot;
+		getWorldsByIDs(unknownWorldIds, &worldsRoot);
+		for (WorldNameEntries::const_iterator it = worldsRoot.world_names.begin(); it != worldsRoot.world_names.end(); it++)
+			worlds[it->first] = it->second.name;
+		for (size_t i = 0; i < unknownWorldIds.size(); i++) {
+			if (worlds.find(unknownWorldIds[i]) == worlds.end())
+				rememberFailure(failedWorlds, unknownWorldIds[i], now);
+		}
+	}
+}
+
+void Gw2NameIndex::resolveMapNames(Gw2Info& info) const {
+	info.setPlaceholderNames(GW2INFO_FIELD_MAP);
+
+	unordered_map<uint32_t, MapNames>::const_iterator map = maps.find(info.mapId);
+	if (map != maps.end()) {
+		info.mapName = map->second.mapName;
+		info.regionId = map->second.regionId;
+		info.regionName = map->second.regionName;
+		info.continentId = map->second.continentId;
+		info.continentName = map->second.continentName;
+	}
+	unordered_map<uint32_t, InternedString>::const_iterator world = worlds.find(info.worldId);
+	if (world != worlds.end())
+		info.worldName = world->second;
+}
+
+void Gw2NameIndex::resolveWaypoint(Gw2Info& info) {
+	info.setPlaceholderNames(GW2INFO_FIELD_WAYPOINT);
+	// Maps that aren't known to the API won't have any waypoints either
+	if (info.waypointId == 0 || info.mapId == 0 || failedMaps.find(info.mapId) != failedMaps.end())
+		return;
+
+	time_t now = time(NULL);
+	uint64_t key = ((uint64_t)info.mapId << 32) | info.waypointId;
+	if (!isRetryDue(failedWaypoints, key, now))
+		return;
+	PointOfInterestEntry waypoint;
+	if (getPointOfInterest(info.mapId, info.waypointId, &waypoint)) {
+		if (!waypoint.name.empty())
+			info.waypointName = waypoint.name;
+		info.waypointContinentPosition = waypoint.coord;
+	} else {
+		rememberFailure(failedWaypoints, key, now);
+	}
+}
+
+
+bool Gw2InfoUpdate::fromCompact(const char* data, size_t length) {
+	info.clear();
+	vector<unsigned char> buffer;
+	if (!base64Decode(data, length, buffer) || buffer.empty() || buffer[0] != GW2INFO_COMPACT_VERSION)
+		return false;
+
+	size_t pos = 1;
+	uint32_t fieldMask;
+	if (!readVarUint(buffer, pos, fieldMask) || !readVarUint(buffer, pos, sequence))
+		return false;
+	fields = (int)fieldMask;
+
+	if (fields & GW2INFO_FIELD_CHARACTER) {
+		if (pos >= buffer.size())
+			return false;
+		info.commander = (buffer[pos++] & 1) != 0;
+		uint32_t professionValue;
+		if (!readVarUint(buffer, pos, professionValue) || !readString(buffer, pos, info.characterName) || !readVarUint(buffer, pos, info.teamColorId))
+			return false;
+		info.profession = (Profession)professionValue;
+	}
+	if ((fields & GW2INFO_FIELD_MAP) && !(readVarUint(buffer, pos, info.mapId) && readVarUint(buffer, pos, info.worldId)))
+		return false;
+	if ((fields & GW2INFO_FIELD_INSTANCE) && !(readVarUint(buffer, pos, info.mapShardId) && readVarUint(buffer, pos, info.mapInstance)))
+		return false;
+	if ((fields & GW2INFO_FIELD_POSITION) && !(readVarInt(buffer, pos, info.characterContinentPosition.x) &&
+		readVarInt(buffer, pos, info.characterContinentPosition.y) && readVarInt(buffer, pos, info.characterContinentPosition.z)))
+		return false;
+	if ((fields & GW2INFO_FIELD_WAYPOINT) && !readVarUint(buffer, pos, info.waypointId))
+		return false;
+	if ((fields & GW2INFO_FIELD_PLUGINVERSION) && !readString(buffer, pos, info.pluginVersion))
+		return false;
+	return true;
 }
 
 
 Gw2RemoteInfoContainer::Gw2RemoteInfoContainer() {
-	InitializeCriticalSection(&cs);
+	InitializeSRWLock(&lock);
+	InitializeCriticalSection(&renderedInfosCs);
+	nextRevision = 0;
 }
 
 Gw2RemoteInfoContainer::~Gw2RemoteInfoContainer() {
-	DeleteCriticalSection(&cs);
+	// SRW locks don't need to be destroyed
+	DeleteCriticalSection(&renderedInfosCs);
 }
 
 static string getDirectionString(Angle::Direction direction) {
@@ -144,96 +689,269 @@ string Gw2RemoteInfoContainer::getInfoData(uint64 serverConnectionHandlerID, any
 }
 
 bool Gw2RemoteInfoContainer::getInfoData(uint64 serverConnectionHandlerID, anyID clientID, PluginItemType type, string& data) {
-	if (type == PLUGIN_CLIENT) {
-		Gw2RemoteInfo gw2RemoteInfo;
-		if (getRemoteGW2Info(serverConnectionHandlerID, clientID, gw2RemoteInfo)) {
-			debuglog("GW2Plugin: Parsing data for client %d\n", clientID);
-			if (gw2RemoteInfo.characterName.empty()) {
-				data = "Currently offline";
-			} else {
-				data = "Playing as [color=blue]" + gw2RemoteInfo.characterName + "[/color] (" + getProfessionName(gw2RemoteInfo.profession) + ")\n" +
-					gw2RemoteInfo.regionName + " - [color=blue]" + gw2RemoteInfo.mapName + "[/color] (" + gw2RemoteInfo.worldName + ")";
-				if (gw2RemoteInfo.waypointId > 0) {
-					Vector2D characterPosition = gw2RemoteInfo.characterContinentPosition.toVector2D();
-					double waypointDistance = characterPosition.getDistance(gw2RemoteInfo.waypointContinentPosition);
-					Angle angle = characterPosition.getAngleFrom(gw2RemoteInfo.waypointContinentPosition);
-					if (waypointDistance < 50) {
-						data += "\nRight next to ";
-					} else if (waypointDistance < 200) {
-						data += "\nNear " + getDirectionString(angle) + " of ";
-					} else if (waypointDistance < 400) {
-						data += "\nSomewhere " + getDirectionString(angle) + " of ";
-					} else if (waypointDistance < 700) {
-						data += "\nFar " + getDirectionString(angle) + " of ";
-					} else {
-						data += "\nVery far " + getDirectionString(angle) + " of ";
-					}
-					data += "[color=blue]" + gw2RemoteInfo.waypointName + "[/color] [&" + poiToChatLink(gw2RemoteInfo.waypointId) + "]";
-				} else {
-					data += "\nNot nearby any waypoint";
-				}
-			}
-			return true;
-		} else {
-			debuglog("GW2Plugin: No data found for client %d\n", clientID);
+	InfoText text = getInfoText(serverConnectionHandlerID, clientID, type);
+	if (!text) {
+		if (type == PLUGIN_CLIENT)
 			data = "No information available";
-		}
+		return false;
 	}
-	return false;
+	data = *text;
+	return true;
 }
 
+Gw2RemoteInfoContainer::InfoText Gw2RemoteInfoContainer::getInfoText(uint64 serverConnectionHandlerID, anyID clientID, PluginItemType type) {
+	if (type != PLUGIN_CLIENT)
+		return InfoText();
 
-bool Gw2RemoteInfoContainer::getRemoteGW2InfoRowID(uint64 serverConnectionHandlerID, anyID clientID, int& result) {
-	unsigned int i = 0;
+	Snapshot snapshot = getRemoteGW2InfoSnapshot(serverConnectionHandlerID, clientID);
+	if (!snapshot) {
+		debuglog("GW2Plugin: No data found for client %d\n", clientID);
+		return InfoText();
+	}
 
-	while (i < gw2RemoteInfos.size()) {
-		Gw2RemoteInfo currentRow = gw2RemoteInfos.at(i);
-		if (currentRow.clientID == clientID && currentRow.serverConnectionHandlerID == serverConnectionHandlerID) {
-			result = i;
-			return true;
+	EnterCriticalSection(&renderedInfosCs);
+	// Removal clears the rendered text after releasing the record lock, so check that the record still exists to not
+	// cache text for a record that has been removed since the snapshot was taken
+	AcquireSRWLockShared(&lock);
+	bool exists = findRemoteGW2Info(serverConnectionHandlerID, clientID) != NULL;
+	ReleaseSRWLockShared(&lock);
+
+	InfoText text;
+	if (!exists) {
+		string* data = new string();
+		renderInfoData(*snapshot, *data);
+		text = InfoText(data);
+	} else {
+		RenderedInfo& renderedInfo = renderedInfos[serverConnectionHandlerID][clientID];
+		if (!renderedInfo.text || renderedInfo.revision != snapshot->revision) {
+			debuglog("GW2Plugin: Parsing data for client %d\n", clientID);
+			string* data = new string();
+			renderInfoData(*snapshot, *data);
+			renderedInfo.text = InfoText(data);
+			renderedInfo.revision = snapshot->revision;
 		}
-		i++;
+		text = renderedInfo.text;
 	}
+	LeaveCriticalSection(&renderedInfosCs);
+	return text;
+}
 
-	return false;
+void Gw2RemoteInfoContainer::renderInfoData(const Gw2RemoteInfo& gw2RemoteInfo, string& data) {
+	if (gw2RemoteInfo.characterName.empty()) {
+		data = "Currently offline";
+		return;
+	}
+
+	data = "Playing as [color=blue]" + gw2RemoteInfo.characterName + "[/color] (" + getProfessionName(gw2RemoteInfo.profession) + ")\n" +
+		gw2RemoteInfo.regionName + " - [color=blue]" + gw2RemoteInfo.mapName + "[/color] (" + gw2RemoteInfo.worldName + ")";
+	if (gw2RemoteInfo.waypointId > 0) {
+		Vector2D characterPosition = gw2RemoteInfo.characterContinentPosition.toVector2D();
+		double waypointDistance = characterPosition.getDistance(gw2RemoteInfo.waypointContinentPosition);
+		Angle angle = characterPosition.getAngleFrom(gw2RemoteInfo.waypointContinentPosition);
+		if (waypointDistance < 50) {
+			data += "\nRight next to ";
+		} else if (waypointDistance < 200) {
+			data += "\nNear " + getDirectionString(angle) + " of ";
+		} else if (waypointDistance < 400) {
+			data += "\nSomewhere " + getDirectionString(angle) + " of ";
+		} else if (waypointDistance < 700) {
+			data += "\nFar " + getDirectionString(angle) + " of ";
+		} else {
+			data += "\nVery far " + getDirectionString(angle) + " of ";
+		}
+		data += "[color=blue]" + gw2RemoteInfo.waypointName + "[/color] [&" + poiToChatLink(gw2RemoteInfo.waypointId) + "]";
+	} else {
+		data += "\nNot nearby any waypoint";
+	}
+}
+
+
+Gw2RemoteInfoContainer::Gw2RemoteInfoPtr* Gw2RemoteInfoContainer::findRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID) {
+	Gw2RemoteInfoPartitions::iterator partition = gw2RemoteInfos.find(serverConnectionHandlerID);
+	if (partition == gw2RemoteInfos.end())
+		return NULL;
+	Gw2RemoteInfoPartition::iterator it = partition->second.find(clientID);
+	return it != partition->second.end() ? &it->second : NULL;
+}
+
+Gw2RemoteInfoContainer::Gw2RemoteInfoPtr Gw2RemoteInfoContainer::copyRemoteGW2Info(const Gw2RemoteInfoPtr& slot) {
+	return Gw2RemoteInfoPtr(new Gw2RemoteInfo(*slot));
+}
+
+Gw2RemoteInfoContainer::Snapshot Gw2RemoteInfoContainer::getRemoteGW2InfoSnapshot(uint64 serverConnectionHandlerID, anyID clientID) {
+	Snapshot snapshot;
+	AcquireSRWLockShared(&lock);
+	Gw2RemoteInfoPtr* existingRecord = findRemoteGW2Info(serverConnectionHandlerID, clientID);
+	if (existingRecord != NULL)
+		snapshot = *existingRecord;
+	ReleaseSRWLockShared(&lock);
+	return snapshot;
 }
 
 bool Gw2RemoteInfoContainer::getRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, Gw2RemoteInfo& result) {
-	int row;
-	if (getRemoteGW2InfoRowID(serverConnectionHandlerID, clientID, row)) {
-		result = gw2RemoteInfos.at(row);
-		return true;
-	}
+	Snapshot snapshot = getRemoteGW2InfoSnapshot(serverConnectionHandlerID, clientID);
+	if (!snapshot)
+		return false;
+	result = *snapshot;
+	return true;
+}
 
-	return false;
+void Gw2RemoteInfoContainer::getRemoteGW2InfoSnapshots(uint64 serverConnectionHandlerID, vector<Snapshot>& result) {
+	AcquireSRWLockShared(&lock);
+	Gw2RemoteInfoPartitions::iterator partition = gw2RemoteInfos.find(serverConnectionHandlerID);
+	if (partition != gw2RemoteInfos.end()) {
+		result.reserve(result.size() + partition->second.size());
+		for (Gw2RemoteInfoPartition::iterator it = partition->second.begin(); it != partition->second.end(); it++)
+			result.push_back(it->second);
+	}
+	ReleaseSRWLockShared(&lock);
 }
 
 void Gw2RemoteInfoContainer::updateRemoteGW2Info(const Gw2RemoteInfo& data) {
-	int existingRecordId;
+	// Build the record before taking the lock, readers that still hold the previous one keep it
+	Gw2RemoteInfoPtr record(new Gw2RemoteInfo(data));
+
+	AcquireSRWLockExclusive(&lock);
+	record->revision = ++nextRevision;
+	record->updateTime = time(NULL);
+	Gw2RemoteInfoPtr& slot = gw2RemoteInfos[data.serverConnectionHandlerID][data.clientID];
+	bool exists = slot.get() != NULL;
+	slot.swap(record);
+	ReleaseSRWLockExclusive(&lock);
 
-	EnterCriticalSection(&cs);
-	if (getRemoteGW2InfoRowID(data.serverConnectionHandlerID, data.clientID, existingRecordId)) {
-		gw2RemoteInfos[existingRecordId] = data;
-		debuglog("GW2Plugin: Updated existing remote GW2 client record in row %d\n", existingRecordId);
+	if (exists) {
+		debuglog("GW2Plugin: Updated existing remote GW2 client record for client %d\n", data.clientID);
 	} else {
-		gw2RemoteInfos.push_back(data);
 		debuglog("GW2Plugin: Added new remote GW2 client record for client %d\n", data.clientID);
 	}
-	LeaveCriticalSection(&cs);
+}
+
+bool Gw2RemoteInfoContainer::updateRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, const char* json, Gw2InfoJsonParser& parser) {
+	Gw2RemoteInfoPtr record;
+	AcquireSRWLockExclusive(&lock);
+	Gw2RemoteInfoPtr& slot = gw2RemoteInfos[serverConnectionHandlerID][clientID];
+	bool exists = slot.get() != NULL;
+	record = exists ? copyRemoteGW2Info(slot) : Gw2RemoteInfoPtr(new Gw2RemoteInfo(serverConnectionHandlerID, clientID));
+	bool parsed = parser.parse(json, *record);
+	record->sequence = 0;
+	record->revision = ++nextRevision;
+	record->updateTime = time(NULL);
+	slot.swap(record);
+	ReleaseSRWLockExclusive(&lock);
+
+	if (exists) {
+		debuglog("GW2Plugin: Updated existing remote GW2 client record for client %d\n", clientID);
+	} else {
+		debuglog("GW2Plugin: Added new remote GW2 client record for client %d\n", clientID);
+	}
+	return parsed;
+}
+
+int Gw2RemoteInfoContainer::getUnchangedNameFields(const Gw2Info& record, const Gw2Info& update, int fields) {
+	int unchangedFields = 0;
+	if ((fields & GW2INFO_FIELD_MAP) && record.mapId == update.mapId && record.worldId == update.worldId)
+		unchangedFields |= GW2INFO_FIELD_MAP;
+	if ((fields & GW2INFO_FIELD_WAYPOINT) && record.mapId == update.mapId && record.waypointId == update.waypointId)
+		unchangedFields |= GW2INFO_FIELD_WAYPOINT;
+	return unchangedFields;
+}
+
+bool Gw2RemoteInfoContainer::updateRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, const Gw2InfoUpdate& update, int& unresolvedFields) {
+	bool applied = true;
+	unresolvedFields = 0;
+
+	// Keyframes replace the whole record, so it can be built before taking the lock
+	Gw2RemoteInfoPtr record;
+	if (update.isKeyframe()) {
+		record = Gw2RemoteInfoPtr(new Gw2RemoteInfo(serverConnectionHandlerID, clientID));
+		record->copyFields(update.info, GW2INFO_FIELDS_ALL);
+		record->sequence = update.sequence;
+	}
+
+	AcquireSRWLockExclusive(&lock);
+	Gw2RemoteInfoPtr* existingRecord = findRemoteGW2Info(serverConnectionHandlerID, clientID);
+	if (update.isKeyframe()) {
+		// Names of ids that didn't change are carried over, the others get placeholders until they're resolved
+		int unchangedFields = existingRecord != NULL ? getUnchangedNameFields(**existingRecord, update.info, GW2INFO_FIELD_MAP | GW2INFO_FIELD_WAYPOINT) : 0;
+		if (unchangedFields != 0)
+			record->copyFields(**existingRecord, unchangedFields);
+		record->setPlaceholderNames((GW2INFO_FIELD_MAP | GW2INFO_FIELD_WAYPOINT) & ~unchangedFields);
+		// Still resolve all names, in case an earlier lookup was dropped and the carried over names are placeholders
+		unresolvedFields = GW2INFO_FIELD_MAP | GW2INFO_FIELD_WAYPOINT;
+		record->revision = ++nextRevision;
+		record->updateTime = time(NULL);
+		gw2RemoteInfos[serverConnectionHandlerID][clientID].swap(record);
+		debuglog("GW2Plugin: Applied keyframe %u for client %d\n", update.sequence, clientID);
+	} else if (existingRecord != NULL && (*existingRecord)->sequence + 1 == update.sequence) {
+		// Groups whose ids didn't change keep their resolved names, e.g. the map group that's sent along with every waypoint
+		int changedFields = update.fields & ~getUnchangedNameFields(**existingRecord, update.info, update.fields);
+		record = copyRemoteGW2Info(*existingRecord);
+		record->copyFields(update.info, changedFields);
+		unresolvedFields = changedFields & (GW2INFO_FIELD_MAP | GW2INFO_FIELD_WAYPOINT);
+		record->setPlaceholderNames(unresolvedFields);
+		record->sequence = update.sequence;
+		record->updateTime = time(NULL);
+		if (changedFields & GW2INFO_FIELDS_RENDERED)
+			record->revision = ++nextRevision;
+		existingRecord->swap(record);
+		debuglog("GW2Plugin: Applied delta %u for client %d\n", update.sequence, clientID);
+	} else {
+		debuglog("GW2Plugin: Missed updates of client %d before delta %u\n", clientID, update.sequence);
+		applied = false;
+	}
+	ReleaseSRWLockExclusive(&lock);
+	// The replaced record is released here, outside of the lock
+	return applied;
+}
+
+bool Gw2RemoteInfoContainer::updateRemoteGW2InfoNames(uint64 serverConnectionHandlerID, anyID clientID, const Gw2Info& names, int fields) {
+	Gw2RemoteInfoPtr record;
+	AcquireSRWLockExclusive(&lock);
+	Gw2RemoteInfoPtr* existingRecord = findRemoteGW2Info(serverConnectionHandlerID, clientID);
+	int applicableFields = 0;
+	if (existingRecord != NULL) {
+		// Names that are already shown don't need a new revision
+		const Gw2RemoteInfo& record = **existingRecord;
+		int unchangedFields = getUnchangedNameFields(record, names, fields);
+		if ((unchangedFields & GW2INFO_FIELD_MAP) && (record.mapName != names.mapName || record.regionId != names.regionId ||
+			record.regionName != names.regionName || record.continentId != names.continentId || record.continentName != names.continentName ||
+			record.worldName != names.worldName))
+			applicableFields |= GW2INFO_FIELD_MAP;
+		if ((unchangedFields & GW2INFO_FIELD_WAYPOINT) && (record.waypointName != names.waypointName ||
+			record.waypointContinentPosition != names.waypointContinentPosition))
+			applicableFields |= GW2INFO_FIELD_WAYPOINT;
+	}
+	if (applicableFields != 0) {
+		record = copyRemoteGW2Info(*existingRecord);
+		record->copyFields(names, applicableFields);
+		record->revision = ++nextRevision;
+		existingRecord->swap(record);
+	}
+	ReleaseSRWLockExclusive(&lock);
+	return applicableFields != 0;
 }
 
 bool Gw2RemoteInfoContainer::removeRemoteGW2InfoRecord(uint64 serverConnectionHandlerID, anyID clientID) {
-	int existingRecord;
+	bool removed = false;
 
-	EnterCriticalSection(&cs);
-	if (getRemoteGW2InfoRowID(serverConnectionHandlerID, clientID, existingRecord)) {
-		gw2RemoteInfos.erase(gw2RemoteInfos.begin() + existingRecord);
-		debuglog("GW2Plugin: Removed remote GW2 client record for client %d\n", clientID);
-		LeaveCriticalSection(&cs);
-		return true;
+	AcquireSRWLockExclusive(&lock);
+	Gw2RemoteInfoPartitions::iterator partition = gw2RemoteInfos.find(serverConnectionHandlerID);
+	if (partition != gw2RemoteInfos.end()) {
+		removed = partition->second.erase(clientID) > 0;
+		if (partition->second.empty())
+			gw2RemoteInfos.erase(partition);
 	}
-	LeaveCriticalSection(&cs);
-	return false;
+	ReleaseSRWLockExclusive(&lock);
+
+	EnterCriticalSection(&renderedInfosCs);
+	RenderedInfoPartitions::iterator renderedPartition = renderedInfos.find(serverConnectionHandlerID);
+	if (renderedPartition != renderedInfos.end())
+		renderedPartition->second.erase(clientID);
+	LeaveCriticalSection(&renderedInfosCs);
+
+	if (removed)
+		debuglog("GW2Plugin: Removed remote GW2 client record for client %d\n", clientID);
+	return removed;
 }
 
 void Gw2RemoteInfoContainer::removeAllRemoteGW2InfoRecords(uint64 serverConnectionHandlerID) {
@@ -241,19 +959,27 @@ void Gw2RemoteInfoContainer::removeAllRemoteGW2InfoRecords(uint64 serverConnecti
 }
 
 void Gw2RemoteInfoContainer::removeAllRemoteGW2InfoRecords(uint64 serverConnectionHandlerID, int* removedRecords) {
-	unsigned int i = 0;
-	int removed = 0;
-
-	EnterCriticalSection(&cs);
-	while (i < gw2RemoteInfos.size()) {
-		if (gw2RemoteInfos[i].serverConnectionHandlerID == serverConnectionHandlerID) {
-			gw2RemoteInfos.erase(gw2RemoteInfos.begin() + i);
-			removed++;
-		} else {
-			i++;
-		}
+	// Only detach the partition while holding the lock, its records are freed after releasing it
+	Gw2RemoteInfoPartition partition;
+
+	AcquireSRWLockExclusive(&lock);
+	Gw2RemoteInfoPartitions::iterator it = gw2RemoteInfos.find(serverConnectionHandlerID);
+	if (it != gw2RemoteInfos.end()) {
+		partition.swap(it->second);
+		gw2RemoteInfos.erase(it);
 	}
-	LeaveCriticalSection(&cs);
+	ReleaseSRWLockExclusive(&lock);
+
+	RenderedInfoPartition renderedPartition;
+	EnterCriticalSection(&renderedInfosCs);
+	RenderedInfoPartitions::iterator renderedIt = renderedInfos.find(serverConnectionHandlerID);
+	if (renderedIt != renderedInfos.end()) {
+		renderedPartition.swap(renderedIt->second);
+		renderedInfos.erase(renderedIt);
+	}
+	LeaveCriticalSection(&renderedInfosCs);
+
+	int removed = (int)partition.size();
 
 	debuglog("GW2Plugin: Removed %d remote GW2 client record(s)\n", removed);
 
@@ -11,25 +11,48 @@
 */
 
 #pragma once
+#include <time.h>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <Windows.h>
 #include "public_definitions.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
 #include "gw2api/math.h"
 #include "gw2api/mumblelink.h"
+#include "gw2api/stringpool.h"
 #include "globals.h"
 
+/* Version of the binary layout produced by Gw2Info::toCompact */
+#define GW2INFO_COMPACT_VERSION 2
+
+/* Field groups of the compact encoding, a delta only contains the groups that changed since the previous transmission */
+#define GW2INFO_FIELD_CHARACTER		(1 << 0)	// Character name, profession, commander tag and team color
+#define GW2INFO_FIELD_MAP			(1 << 1)	// Map and world
+#define GW2INFO_FIELD_INSTANCE		(1 << 2)	// Map shard and instance
+#define GW2INFO_FIELD_POSITION		(1 << 3)	// Character continent position
+#define GW2INFO_FIELD_WAYPOINT		(1 << 4)	// Closest waypoint, always sent together with GW2INFO_FIELD_MAP to resolve it
+#define GW2INFO_FIELD_PLUGINVERSION	(1 << 5)
+#define GW2INFO_FIELDS_ALL			((1 << 6) - 1)
+#define GW2INFO_FIELDS_RENDERED		(GW2INFO_FIELD_CHARACTER | GW2INFO_FIELD_MAP | GW2INFO_FIELD_POSITION | GW2INFO_FIELD_WAYPOINT) // Shown in the info panel
+#define GW2INFO_KEYFRAME			(1 << 7)	// Replaces the whole record instead of applying to the previous one
+
 struct Gw2Info {
 	std::string characterName;
 	Gw2Api::MumbleLink::Profession profession;
 	uint32_t mapId;
-	std::string mapName;
+	Gw2Api::InternedString mapName;
+	uint32_t mapShardId;
+	uint32_t mapInstance;
 	uint32_t regionId;
-	std::string regionName;
+	Gw2Api::InternedString regionName;
 	uint32_t continentId;
-	std::string continentName;
+	Gw2Api::InternedString continentName;
 	uint32_t worldId;
-	std::string worldName;
+	Gw2Api::InternedString worldName;
 	Gw2Api::Vector3D characterContinentPosition;
 	uint32_t waypointId;
 	std::string waypointName;
@@ -39,20 +62,36 @@ struct Gw2Info {
 	std::string pluginVersion;
 
 	Gw2Info() { clear(); }
-	Gw2Info(std::string jsonString);
+	Gw2Info(const char* json);
 
 	std::string toJson() const;
+	/* Streams the JSON encoding into a writer, which may be reused across calls */
+	void toJson(rapidjson::Writer<rapidjson::StringBuffer>& writer) const;
+	/* Returns the GW2INFO_FIELD_* groups that differ between both records, as they would be transmitted in the compact encoding */
+	int getChangedFields(const Gw2Info& other) const;
+	/* Text-safe encoding that only contains ids and rounded positions, names are resolved by the receiver */
+	std::string toCompact(uint32_t sequence, int fields) const;
+	/* Copies the given GW2INFO_FIELD_* groups from another record */
+	void copyFields(const Gw2Info& other, int fields);
+
+	/* Fills in the map, region, continent and world names and ids based on mapId and worldId */
+	void resolveMapNames();
+	/* Sets the names of the GW2INFO_FIELD_MAP and GW2INFO_FIELD_WAYPOINT groups to placeholders based on the ids, until they're resolved */
+	void setPlaceholderNames(int fields);
+
 	void clear() {
 		characterName = "";
 		profession = (Gw2Api::MumbleLink::Profession)0;
 		mapId = 0;
-		mapName = "";
+		mapName = Gw2Api::InternedString();
+		mapShardId = 0;
+		mapInstance = 0;
 		regionId = 0;
-		regionName = "";
+		regionName = Gw2Api::InternedString();
 		continentId = 0;
-		continentName = "";
+		continentName = Gw2Api::InternedString();
 		worldId = 0;
-		worldName = "";
+		worldName = Gw2Api::InternedString();
 		characterContinentPosition = Gw2Api::Vector3D();
 		waypointId = 0;
 		waypointName = "";
@@ -63,26 +102,145 @@ struct Gw2Info {
 	}
 };
 
+/*
+ * Parses the JSON encoding of the GW2Info command into an existing record with a SAX reader instead of a document. The reader
+ * keeps its memory pool between calls, so parsing stops allocating once it has seen the longest message. Not thread-safe.
+ */
+class Gw2InfoJsonParser {
+private:
+	rapidjson::MemoryPoolAllocator<> allocator;
+	rapidjson::GenericReader<rapidjson::UTF8<>, rapidjson::MemoryPoolAllocator<> > reader;
+
+public:
+	Gw2InfoJsonParser() : reader(&allocator) { }
+
+	/* Replaces all fields of the record, members that are missing are cleared; returns false and clears the record if the JSON is invalid */
+	bool parse(const char* json, Gw2Info& info);
+};
+
+/* A decoded compact keyframe or delta, only the fields in the field mask are valid */
+struct Gw2InfoUpdate {
+	uint32_t sequence;
+	int fields;
+	Gw2Info info;
+
+	Gw2InfoUpdate() {
+		sequence = 0;
+		fields = 0;
+	}
+
+	bool isKeyframe() const { return (fields & GW2INFO_KEYFRAME) != 0; }
+
+	bool fromCompact(const char* data, size_t length);
+};
+
+/* Seconds before ids that couldn't be looked up are requested again */
+#define GW2NAMEINDEX_RETRY_DELAY 300
+/* Failed ids that are remembered at most per kind, peers could otherwise fill the index with made up ids */
+#define GW2NAMEINDEX_MAX_FAILED_IDS 1024
+
+/*
+ * Map and world names by id, shared by all records whose names are resolved on receive. Ids that aren't known yet are looked
+ * up in batches with the v2 API, ids that can't be found are only requested again after GW2NAMEINDEX_RETRY_DELAY. Not
+ * thread-safe, it's only used by the remote name resolve thread.
+ */
+class Gw2NameIndex {
+private:
+	struct MapNames {
+		Gw2Api::InternedString mapName;
+		uint32_t regionId;
+		Gw2Api::InternedString regionName;
+		uint32_t continentId;
+		Gw2Api::InternedString continentName;
+	};
+	std::unordered_map<uint32_t, MapNames> maps;
+	std::unordered_map<uint32_t, Gw2Api::InternedString> worlds;
+
+	// Ids that couldn't be looked up, with the time they failed; they aren't requested again until the retry delay has passed
+	typedef std::unordered_map<uint64_t, time_t> FailedIds;
+	FailedIds failedMaps;
+	FailedIds failedWorlds;
+	FailedIds failedWaypoints; // Keyed by map id and waypoint id
+	static bool isRetryDue(FailedIds& failedIds, uint64_t id, time_t now);
+	static void rememberFailure(FailedIds& failedIds, uint64_t id, time_t now);
+
+public:
+	/* Looks up the maps and worlds that aren't known yet, with one request per kind for up to 200 ids */
+	void prefetch(const std::vector<int>& mapIds, const std::vector<int>& worldIds);
+	/* Fills in the names and ids like Gw2Info::resolveMapNames, ids that aren't known get placeholders */
+	void resolveMapNames(Gw2Info& info) const;
+	/* Fills in the name and position of the waypoint, waypoints that can't be found get placeholders */
+	void resolveWaypoint(Gw2Info& info);
+};
+
 struct Gw2RemoteInfo : Gw2Info {
 	uint64 serverConnectionHandlerID;
 	anyID clientID;
+	uint32_t sequence; // Sequence number of the last applied compact update
+	uint32_t revision; // Changes whenever a field that is shown in the info panel changes, assigned by Gw2RemoteInfoContainer
+	time_t updateTime; // When the last update was applied, set by Gw2RemoteInfoContainer
 
-	Gw2RemoteInfo() : Gw2Info() { }
-	Gw2RemoteInfo(std::string jsonString, uint64 serverConnectionHandlerID, anyID clientID) : Gw2Info(jsonString) {
+	Gw2RemoteInfo() : Gw2Info() {
+		sequence = 0;
+		revision = 0;
+		updateTime = 0;
+	}
+	Gw2RemoteInfo(uint64 serverConnectionHandlerID, anyID clientID) : Gw2Info() {
 		this->serverConnectionHandlerID = serverConnectionHandlerID;
 		this->clientID = clientID;
+		sequence = 0;
+		revision = 0;
+		updateTime = 0;
+	}
+	Gw2RemoteInfo(const char* json, uint64 serverConnectionHandlerID, anyID clientID) : Gw2Info(json) {
+		this->serverConnectionHandlerID = serverConnectionHandlerID;
+		this->clientID = clientID;
+		sequence = 0;
+		revision = 0;
+		updateTime = 0;
 	}
 };
 
 
+/*
+ * Records are shared immutable snapshots as far as readers are concerned. Readers only hold the lock in shared mode to take
+ * a reference to a record, and render from it without any lock. Writers never modify a stored record, they always replace it
+ * with an updated copy while holding the lock exclusively.
+ */
 class Gw2RemoteInfoContainer {
 
+public:
+	typedef std::shared_ptr<const Gw2RemoteInfo> Snapshot;
+	typedef std::shared_ptr<const std::string> InfoText;
+
 private:
-	std::vector<Gw2RemoteInfo> gw2RemoteInfos;
+	typedef std::shared_ptr<Gw2RemoteInfo> Gw2RemoteInfoPtr;
+	// Records are partitioned per server connection, so a whole server can be dropped at once
+	typedef std::unordered_map<anyID, Gw2RemoteInfoPtr> Gw2RemoteInfoPartition;
+	typedef std::unordered_map<uint64, Gw2RemoteInfoPartition> Gw2RemoteInfoPartitions;
+	Gw2RemoteInfoPartitions gw2RemoteInfos;
+	uint32_t nextRevision;
+
+	// Rendered info panel text of the last rendered revision of each record
+	struct RenderedInfo {
+		uint32_t revision;
+		InfoText text;
+	};
+	typedef std::unordered_map<anyID, RenderedInfo> RenderedInfoPartition;
+	typedef std::unordered_map<uint64, RenderedInfoPartition> RenderedInfoPartitions;
+	RenderedInfoPartitions renderedInfos;
+	CRITICAL_SECTION renderedInfosCs;
+
+	static void renderInfoData(const Gw2RemoteInfo& gw2RemoteInfo, std::string& data);
+	/* Returns the GW2INFO_FIELD_MAP and GW2INFO_FIELD_WAYPOINT groups of fields whose ids are the same in both records */
+	static int getUnchangedNameFields(const Gw2Info& record, const Gw2Info& update, int fields);
 
 protected:
-	CRITICAL_SECTION cs;
-	bool getRemoteGW2InfoRowID(uint64 serverConnectionHandlerID, anyID clientID, int& result);
+	SRWLOCK lock;
+	/* Returns the slot of the stored record, or NULL if there is none; only valid while the lock is held */
+	Gw2RemoteInfoPtr* findRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID);
+	/* Returns a new copy of the stored record to modify; readers never see it until it replaces the stored one under the exclusive lock */
+	static Gw2RemoteInfoPtr copyRemoteGW2Info(const Gw2RemoteInfoPtr& slot);
 
 public:
 	Gw2RemoteInfoContainer();
@@ -90,9 +248,25 @@ public:
 
 	std::string getInfoData(uint64 serverConnectionHandlerID, anyID clientID, enum PluginItemType type);
 	bool getInfoData(uint64 serverConnectionHandlerID, anyID clientID, enum PluginItemType type, std::string& data);
+	/* Returns the info panel text, which is only rendered again if the record changed since the last call */
+	InfoText getInfoText(uint64 serverConnectionHandlerID, anyID clientID, enum PluginItemType type);
 
+	/* Returns the current record without copying it, or an empty pointer if there is none; the record never changes afterwards */
+	Snapshot getRemoteGW2InfoSnapshot(uint64 serverConnectionHandlerID, anyID clientID);
 	bool getRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, Gw2RemoteInfo& result);
+	/* Appends snapshots of all records of a server connection */
+	void getRemoteGW2InfoSnapshots(uint64 serverConnectionHandlerID, std::vector<Snapshot>& result);
 	void updateRemoteGW2Info(const Gw2RemoteInfo& data);
+	/* Parses a JSON encoded record directly into the stored record of the client */
+	bool updateRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, const char* json, Gw2InfoJsonParser& parser);
+	/*
+	 * Applies a keyframe, or a delta that directly follows the last applied update; returns false if a delta can't be applied.
+	 * The names of groups whose ids changed are set to placeholders and returned in unresolvedFields to be resolved, the others
+	 * are kept. Keyframes return all groups, so names that were never resolved get another chance.
+	 */
+	bool updateRemoteGW2Info(uint64 serverConnectionHandlerID, anyID clientID, const Gw2InfoUpdate& update, int& unresolvedFields);
+	/* Fills in the names of the GW2INFO_FIELD_MAP and GW2INFO_FIELD_WAYPOINT groups once they're resolved, unless the ids of the record have changed since */
+	bool updateRemoteGW2InfoNames(uint64 serverConnectionHandlerID, anyID clientID, const Gw2Info& names, int fields);
 	bool removeRemoteGW2InfoRecord(uint64 serverConnectionHandlerID, anyID clientID);
 	void removeAllRemoteGW2InfoRecords(uint64 serverConnectionHandlerID);
 	void removeAllRemoteGW2InfoRecords(uint64 serverConnectionHandlerID, int* removedRecords);
@@ -14,34 +14,80 @@
 #include "gw2api/gw2api.h"
 using namespace Gw2Api;
 
+typedef BasicMapFloorEntry<ResponseArenaAllocator> CachedMapFloorEntry;
+
+// Looks up the floor of a map in a cached map floor response, without copying it
+static const CachedMapFloorEntry* findCachedMapFloor(const ArenaMapFloorRootEntry* mapFloorRoot, const BasicMapEntry<ResponseArenaAllocator>& map, int map_id) {
+	if (mapFloorRoot == NULL)
+		return NULL;
+	EntryDictionary<int, BasicMapFloorRegionEntry<ResponseArenaAllocator>, ResponseArenaAllocator>::const_iterator region = mapFloorRoot->value->regions.find(map.region_id);
+	if (region == mapFloorRoot->value->regions.end())
+		return NULL;
+	EntryDictionary<int, CachedMapFloorEntry, ResponseArenaAllocator>::const_iterator mapFloor = region->second.maps.find(map_id);
+	if (mapFloor == region->second.maps.end())
+		return NULL;
+	return &mapFloor->second;
+}
+
+// Loads all floors of a map at once instead of one request after another
+static void getCachedMapFloors(const BasicMapEntry<ResponseArenaAllocator>& map, std::vector<const ArenaMapFloorRootEntry*>* mapFloorRoots) {
+	if (map.floors.empty())
+		mapFloorRoots->clear();
+	else
+		Gw2Api::getCachedMapFloors(map.continent_id, &map.floors[0], map.floors.size(), mapFloorRoots);
+}
+
 bool getClosestWaypoint(const Vector3D& characterContinentPosition, int map_id, PointOfInterestEntry* waypoint) {
-	ApiInnerResponseObject<MapsRootEntry, MapEntry> map;
-	getMap(map_id, &map);
+	const BasicMapEntry<ResponseArenaAllocator>* map = getCachedMap(map_id);
+	if (map == NULL)
+		return !waypoint->name.empty();
+	std::vector<const ArenaMapFloorRootEntry*> mapFloorRoots;
+	getCachedMapFloors(*map, &mapFloorRoots);
 
 	Vector2D position2D = characterContinentPosition.toVector2D();
+	const BasicPointOfInterestEntry<ResponseArenaAllocator>* closest = NULL;
 	double currentDistance;
-	for (unsigned i = 0; i < map.value.floors.size(); i++) {
-		int floor = map.value.floors[i];
-		MapFloorRootEntry mapFloorRoot;
-		getMapFloor(map.value.continent_id, floor, &mapFloorRoot);
-		MapFloorEntry mapFloor = mapFloorRoot.regions[map.value.region_id].maps[map_id];
-
-		for (unsigned j = 0; j < mapFloor.points_of_interest.size(); j++) {
-			if (mapFloor.points_of_interest[j].type == "waypoint") {
-				if (waypoint->name.empty()) {
-					*waypoint = mapFloor.points_of_interest[j];
-					currentDistance = waypoint->coord.getDistance(position2D);
-				}
-				else {
-					double distance = mapFloor.points_of_interest[j].coord.getDistance(position2D);
-					if (distance < currentDistance) {
-						*waypoint = mapFloor.points_of_interest[j];
-						currentDistance = distance;
-					}
+	for (unsigned i = 0; i < mapFloorRoots.size(); i++) {
+		const CachedMapFloorEntry* mapFloor = findCachedMapFloor(mapFloorRoots[i], *map, map_id);
+		if (mapFloor == NULL)
+			continue;
+
+		for (unsigned j = 0; j < mapFloor->points_of_interest.size(); j++) {
+			const BasicPointOfInterestEntry<ResponseArenaAllocator>& poi = mapFloor->points_of_interest[j];
+			if (poi.type == "waypoint") {
+				double distance = poi.coord.getDistance(position2D);
+				if (closest == NULL || distance < currentDistance) {
+					closest = &poi;
+					currentDistance = distance;
 				}
 			}
 		}
 	}
 
+	// Only the closest waypoint is copied out of the cache
+	if (closest != NULL)
+		*waypoint = PointOfInterestEntry(*closest);
 	return !waypoint->name.empty();
 }
+
+bool getPointOfInterest(int map_id, int poi_id, PointOfInterestEntry* poi) {
+	const BasicMapEntry<ResponseArenaAllocator>* map = getCachedMap(map_id);
+	if (map == NULL)
+		return false;
+	std::vector<const ArenaMapFloorRootEntry*> mapFloorRoots;
+	getCachedMapFloors(*map, &mapFloorRoots);
+
+	for (unsigned i = 0; i < mapFloorRoots.size(); i++) {
+		const CachedMapFloorEntry* mapFloor = findCachedMapFloor(mapFloorRoots[i], *map, map_id);
+		if (mapFloor == NULL)
+			continue;
+
+		for (unsigned j = 0; j < mapFloor->points_of_interest.size(); j++) {
+			if (mapFloor->points_of_interest[j].poi_id == poi_id) {
+				*poi = PointOfInterestEntry(mapFloor->points_of_interest[j]);
+				return true;
+			}
+		}
+	}
+	return false;
+}
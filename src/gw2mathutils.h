@@ -15,3 +15,4 @@
 #include "gw2api/objects.h"
 
 bool getClosestWaypoint(const Gw2Api::Vector3D& characterContinentPosition, int map_id, Gw2Api::PointOfInterestEntry* waypoint);
+bool getPointOfInterest(int map_id, int poi_id, Gw2Api::PointOfInterestEntry* poi);
@@ -0,0 +1,128 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+#pragma once
+#include <time.h>
+#include <Windows.h>
+#include "gw2api/math.h"
+#include "gw2api/mumblelink.h"
+#include "gw2info.h"
+
+/*
+ * Lock-free queue for exactly one producer thread and one consumer thread.
+ * One slot is always kept empty to distinguish a full queue from an empty one.
+ */
+template<class T, LONG Capacity>
+class SpscQueue {
+
+private:
+	T items[Capacity];
+	volatile LONG head; // Next slot to read, only written by the consumer
+	volatile LONG tail; // Next slot to write, only written by the producer
+
+public:
+	SpscQueue() {
+		head = 0;
+		tail = 0;
+	}
+
+	/* Returns false if the queue is full */
+	bool push(const T& item) {
+		LONG currentTail = tail;
+		LONG nextTail = (currentTail + 1) % Capacity;
+		if (nextTail == head)
+			return false;
+
+		items[currentTail] = item;
+		MemoryBarrier(); // Publish the item before the new tail
+		tail = nextTail;
+		return true;
+	}
+
+	/* Returns false if the queue is empty */
+	bool pop(T& item) {
+		LONG currentHead = head;
+		if (currentHead == tail)
+			return false;
+
+		MemoryBarrier(); // Read the item only after seeing the new tail
+		item = items[currentHead];
+		MemoryBarrier(); // Finish reading the item before handing the slot back
+		head = (currentHead + 1) % Capacity;
+		return true;
+	}
+
+};
+
+
+enum LinkEventType {
+	LINKEVENT_IDENTITYCHANGED = 0,
+	LINKEVENT_MOVED,
+	LINKEVENT_INSTANCECHANGED,
+	LINKEVENT_WENTOFFLINE
+};
+
+/*
+ * Emitted by the Mumble Link thread. Every event carries the complete link state of the tick it was created in,
+ * so consumers can always catch up with the latest state, even if an earlier event has been dropped.
+ */
+struct LinkEvent {
+	LinkEventType type;
+	time_t time;
+	Gw2Api::MumbleLink::MumbleIdentity identity;
+	Gw2Api::Vector3D avatarPosition;
+	Gw2Api::MumbleLink::MumbleContextSnapshot context;
+
+	LinkEvent() {
+		type = LINKEVENT_IDENTITYCHANGED;
+		time = 0;
+	}
+};
+
+enum TransmitReason {
+	TRANSMIT_IDENTITY = 1 << 0,
+	TRANSMIT_POSITION = 1 << 1,
+	TRANSMIT_INSTANCE = 1 << 2,
+	TRANSMIT_OFFLINE = 1 << 3
+};
+
+/* Emitted by the resolving thread once the names and waypoint of a change have been looked up */
+struct TransmitRequest {
+	int reasons; // Combination of TransmitReason flags
+	Gw2Info gw2Info;
+	Gw2Api::Vector2D avatarPosition;
+
+	TransmitRequest() { reasons = 0; }
+};
+
+/* Emitted by the plugin command handler once a compact update of another client has been applied, the names of its ids are looked up by the remote name resolving thread */
+struct RemoteNameRequest {
+	uint64 serverConnectionHandlerID;
+	anyID clientID;
+	int fields; // GW2INFO_FIELD_MAP and/or GW2INFO_FIELD_WAYPOINT
+	uint32_t mapId;
+	uint32_t worldId;
+	uint32_t waypointId;
+
+	RemoteNameRequest() {
+		serverConnectionHandlerID = 0;
+		clientID = 0;
+		fields = 0;
+		mapId = 0;
+		worldId = 0;
+		waypointId = 0;
+	}
+};
+
+#define LINKEVENT_QUEUE_CAPACITY 64
+#define TRANSMITREQUEST_QUEUE_CAPACITY 16
+#define REMOTENAMEREQUEST_QUEUE_CAPACITY 64
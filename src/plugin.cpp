@@ -25,11 +25,14 @@
 #include "rapidjson/stringbuffer.h"
 #include "gw2api/gw2api.h"
 #include "gw2api/mumblelink.h"
+#include "gw2api/mumblelinksource.h"
+#include "gw2api/mumblelinktrace.h"
 #include "commands.h"
 #include "plugin.h"
 #include "globals.h"
 #include "gw2info.h"
 #include "gw2mathutils.h"
+#include "linkevents.h"
 #include "stringutils.h"
 #include "updatechecker.h"
 #include "configdialog.h"
@@ -37,17 +40,54 @@ using namespace std;
 using namespace Globals;
 
 static Gw2Info gw2Info;
+static CRITICAL_SECTION gw2InfoCs;
 static Gw2RemoteInfoContainer gw2RemoteInfoContainer;
+static Gw2InfoJsonParser gw2InfoJsonParser; // Only used by ts3plugin_onPluginCommandEvent
 
 static PluginItemType infoDataType = (PluginItemType)0;
 static uint64 infoDataId = 0;
 
+/* Received records older than this (in seconds) are requested again when the client is selected */
+#define GW2INFO_MAX_RECORD_AGE 300
+
+/*
+ * Info panel refreshes are coalesced and requested at most once per interval (in ms), so at most 4 per second. Requesting one from
+ * another thread crashes TS3, so the flush runs from a thread timer of the TeamSpeak thread that loaded the plugin (the same thread
+ * that calls ts3plugin_infoData); other threads only set the pending flag.
+ */
+#define INFOPANEL_UPDATE_INTERVAL 250
+static volatile LONG infoPanelUpdatePending = 0;
+static UINT_PTR infoPanelUpdateTimer = 0;
+static uint32_t infoPanelRevision = 0; // Revision of the record the info panel shows, 0 without a record
+
 static time_t lastUpdateCheck = 0;
-static bool threadStopRequested = false;
+static volatile bool threadStopRequested = false;
 static HANDLE hThread = 0;
+static HANDLE hResolveThread = 0;
+static HANDLE hTransmitThread = 0;
+static HANDLE hRemoteNameResolveThread = 0;
+
+/* Mumble Link thread -> resolve thread -> transmit thread */
+static SpscQueue<LinkEvent, LINKEVENT_QUEUE_CAPACITY> linkEvents;
+static SpscQueue<TransmitRequest, TRANSMITREQUEST_QUEUE_CAPACITY> transmitRequests;
+static HANDLE hLinkEventsAvailable = 0;
+static HANDLE hTransmitRequestsAvailable = 0;
+
+/* Plugin command handler -> remote name resolve thread, so names are never looked up on the TeamSpeak thread */
+static SpscQueue<RemoteNameRequest, REMOTENAMEREQUEST_QUEUE_CAPACITY> remoteNameRequests;
+static HANDLE hRemoteNameRequestsAvailable = 0;
 
 DWORD WINAPI checkForUpdatesAsync(LPVOID lpParam);
 DWORD WINAPI mumbleLinkCheckLoop(LPVOID lpParam);
+DWORD WINAPI gw2InfoResolveLoop(LPVOID lpParam);
+DWORD WINAPI gw2InfoTransmitLoop(LPVOID lpParam);
+DWORD WINAPI gw2RemoteNameResolveLoop(LPVOID lpParam);
+static void stopThread(HANDLE hThread, const char* name);
+static void stopThreads();
+static void scheduleInfoPanelUpdate();
+static void CALLBACK infoPanelTimer(HWND hwnd, UINT message, UINT_PTR timerID, DWORD tickCount);
+static void queueRemoteNameRequest(uint64 serverConnectionHandlerID, anyID clientID, const Gw2InfoUpdate& update, int fields);
+static void requestGW2InfoIfOutdated(uint64 serverConnectionHandlerID, anyID clientID);
 
 
 /*********************************** Required functions ************************************/
@@ -95,10 +135,28 @@ int ts3plugin_init() {
 
 	Globals::loadConfig();
 
+	InitializeCriticalSection(&gw2InfoCs);
+	hLinkEventsAvailable = CreateEventW(NULL, FALSE, FALSE, NULL);
+	hTransmitRequestsAvailable = CreateEventW(NULL, FALSE, FALSE, NULL);
+	hRemoteNameRequestsAvailable = CreateEventW(NULL, FALSE, FALSE, NULL);
+
 	threadStopRequested = false;
+	hTransmitThread = CreateThread(NULL, 0, gw2InfoTransmitLoop, NULL, 0, NULL);
+	hResolveThread = CreateThread(NULL, 0, gw2InfoResolveLoop, NULL, 0, NULL);
+	hRemoteNameResolveThread = CreateThread(NULL, 0, gw2RemoteNameResolveLoop, NULL, 0, NULL);
 	hThread = CreateThread(NULL, 0, mumbleLinkCheckLoop, NULL, 0, NULL);
-	if (hThread == 0) {
-		debuglog("\tCould not create thread to check for Guild Wars 2 updates through Mumble Link: %d\n", GetLastError());
+	if (hThread == 0 || hResolveThread == 0 || hTransmitThread == 0 || hRemoteNameResolveThread == 0) {
+		debuglog("\tCould not create threads to check for Guild Wars 2 updates through Mumble Link: %d\n", GetLastError());
+		stopThreads();
+		DeleteCriticalSection(&gw2InfoCs);
+		return 1;
+	}
+
+	infoPanelUpdateTimer = SetTimer(NULL, 0, INFOPANEL_UPDATE_INTERVAL, infoPanelTimer);
+	if (infoPanelUpdateTimer == 0) {
+		debuglog("\tCould not create the info panel update timer: %d\n", GetLastError());
+		stopThreads();
+		DeleteCriticalSection(&gw2InfoCs);
 		return 1;
 	}
 
@@ -120,35 +178,14 @@ void ts3plugin_shutdown() {
 	/* Your plugin cleanup code here */
 	debuglog("GW2Plugin: shutdown\n");
 
-	if (hThread != 0) {
-		bool threadClosed = false;
-		threadStopRequested = true;
-		DWORD threadReturn = WaitForSingleObject(hThread, 1000);
-		switch (threadReturn) {
-			case WAIT_ABANDONED:
-				debuglog("\tGuild Wars 2 checker thread has been abandoned\n");
-				break;
-			case WAIT_OBJECT_0:
-				debuglog("\tGuild Wars 2 checker thread has exited\n");
-				CloseHandle(hThread);
-				threadClosed = true;
-				break;
-			case WAIT_TIMEOUT:
-				debuglog("\tGuild Wars 2 checker thread has timed out\n");
-				break;
-			case WAIT_FAILED:
-				debuglog("\tWaiting on Guild Wars 2 checker thread has failed: %d\n", GetLastError());
-				break;
-		}
-
-		/* In case the thread has not been exited within the given timeout, terminate it to prevent hanging */
-		if (!threadClosed) {
-			TerminateThread(hThread, 0);
-			CloseHandle(hThread);
-		}
+	if (infoPanelUpdateTimer != 0) {
+		KillTimer(NULL, infoPanelUpdateTimer);
+		infoPanelUpdateTimer = 0;
 	}
+	stopThreads();
 
 	gw2Info.clear();
+	DeleteCriticalSection(&gw2InfoCs);
 
 	/* In case the plugin was deactivated without shutting down TeamSpeak, we need to let the other clients know */
 	uint64 serverConnectionHandlerID = ts3Functions.getCurrentServerConnectionHandlerID();
@@ -238,10 +275,18 @@ void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 clientID, enum
 	infoDataType = type;
 	infoDataId = clientID;
 
+	// The panel is rendered right now, so the timer only refreshes it again once there's a newer record
+	if (type == PLUGIN_CLIENT) {
+		Gw2RemoteInfoContainer::Snapshot snapshot = gw2RemoteInfoContainer.getRemoteGW2InfoSnapshot(serverConnectionHandlerID, (anyID)clientID);
+		infoPanelRevision = snapshot ? snapshot->revision : 0;
+	}
+
 	try {
-		string result = gw2RemoteInfoContainer.getInfoData(serverConnectionHandlerID, (anyID)clientID, type);
-		if (result.length() > 0) {
-			*data = _strdup(result.c_str());
+		Gw2RemoteInfoContainer::InfoText result = gw2RemoteInfoContainer.getInfoText(serverConnectionHandlerID, (anyID)clientID, type);
+		if (result) {
+			*data = _strdup(result->c_str());
+		} else if (type == PLUGIN_CLIENT) {
+			*data = _strdup("No information available");
 		} else {
 			*data = NULL;
 		}
@@ -251,7 +296,7 @@ void ts3plugin_infoData(uint64 serverConnectionHandlerID, uint64 clientID, enum
 	}
 
 	if (isNew && type == PLUGIN_CLIENT)
-		Commands::requestGW2Info(serverConnectionHandlerID, PluginCommandTarget_CLIENT, (anyID*)&clientID);
+		requestGW2InfoIfOutdated(serverConnectionHandlerID, (anyID)clientID);
 }
 
 /* Required to release the memory for parameter "data" allocated in ts3plugin_infoData and ts3plugin_initMenus */
@@ -282,6 +327,8 @@ void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int
 		case STATUS_DISCONNECTED: {
 			debuglog("GW2Plugin: Disconnected; removing all previous received client data\n");			
 			gw2RemoteInfoContainer.removeAllRemoteGW2InfoRecords(serverConnectionHandlerID);
+			Commands::removeAllPeers(serverConnectionHandlerID);
+			Commands::resetTransmitState(serverConnectionHandlerID);
 			break;
 		}
 		case STATUS_CONNECTION_ESTABLISHED:
@@ -294,6 +341,7 @@ void ts3plugin_onConnectStatusChangeEvent(uint64 serverConnectionHandlerID, int
 void ts3plugin_onClientKickFromServerEvent(uint64 serverConnectionHandlerID, anyID clientID, uint64 oldChannelID, uint64 newChannelID, int visibility, anyID kickerID, const char* kickerName, const char* kickerUniqueIdentifier, const char* kickMessage) {
 	debuglog("GW2Plugin: Client %d has been kicked from server, removing received data\n", clientID);
 	gw2RemoteInfoContainer.removeRemoteGW2InfoRecord(serverConnectionHandlerID, clientID);
+	Commands::removePeer(serverConnectionHandlerID, clientID);
 }
 
 int ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char* errorMessage, unsigned int error, const char* returnCode, const char* extraMessage) {
@@ -311,6 +359,7 @@ int ts3plugin_onServerErrorEvent(uint64 serverConnectionHandlerID, const char* e
 void ts3plugin_onServerStopEvent(uint64 serverConnectionHandlerID, const char* shutdownMessage) {
 	debuglog("GW2Plugin: Server stopped; removing all previous received client data\n");
 	gw2RemoteInfoContainer.removeAllRemoteGW2InfoRecords(serverConnectionHandlerID);
+	Commands::removeAllPeers(serverConnectionHandlerID);
 }
 
 /* Clientlib rare */
@@ -318,46 +367,186 @@ void ts3plugin_onServerStopEvent(uint64 serverConnectionHandlerID, const char* s
 void ts3plugin_onPluginCommandEvent(uint64 serverConnectionHandlerID, const char* pluginName, const char* pluginCommand) {
 	debuglog("GW2Plugin: Received command '%s'\n", pluginCommand);
 
-	Commands::CommandType commandType;
-	vector<string> commandParameters;
-	Commands::parseCommand(pluginCommand, commandType, commandParameters);
+	Commands::Command command;
+	Commands::parseCommand(pluginCommand, command);
+	const StringRef* commandParameters = command.parameters;
 
-	switch(commandType) {
+	switch(command.type) {
 		case Commands::CMD_NONE:
 			debuglog("\tUnknown command\n");
 			break;  /* Command not handled by plugin */
 		case Commands::CMD_GW2INFO: {
-			if (commandParameters.size() != 2) {
-				debuglog("\tInvalid parameter count: %d\n", commandParameters.size());
+			if (command.parameterCount != 2) {
+				debuglog("\tInvalid parameter count: %d\n", command.parameterCount);
 				break;
 			}
-			debuglog("\tCommand: GW2Info\n\tClient: %s\n\tData: %s\n", commandParameters.at(0).c_str(), commandParameters.at(1).c_str());
+			debuglog("\tCommand: GW2Info\n\tClient: %.*s\n\tData: %s\n", (int)commandParameters[0].length, commandParameters[0].data, commandParameters[1].data);
 			
-			anyID clientID = (anyID)atoi(commandParameters.at(0).c_str());
-			string jsonString = commandParameters.at(1);
-			Gw2RemoteInfo gw2RemoteInfo = Gw2RemoteInfo(jsonString, serverConnectionHandlerID, clientID);
-			gw2RemoteInfoContainer.updateRemoteGW2Info(gw2RemoteInfo);
-			updateInfoPanel();
+			anyID clientID = (anyID)commandParameters[0].toInt();
+			Commands::setPeerProtocolVersion(serverConnectionHandlerID, clientID, PROTOCOL_VERSION_JSON);
+			if (!gw2RemoteInfoContainer.updateRemoteGW2Info(serverConnectionHandlerID, clientID, commandParameters[1].data, gw2InfoJsonParser))
+				debuglog("\tInvalid data\n");
+			scheduleInfoPanelUpdate();
+			break;
+		}
+		case Commands::CMD_GW2INFOCOMPACT: {
+			if (command.parameterCount != 2) {
+				debuglog("\tInvalid parameter count: %d\n", command.parameterCount);
+				break;
+			}
+			debuglog("\tCommand: GW2InfoCompact\n\tClient: %.*s\n\tData: %s\n", (int)commandParameters[0].length, commandParameters[0].data, commandParameters[1].data);
+
+			anyID clientID = (anyID)commandParameters[0].toInt();
+			Gw2InfoUpdate update;
+			if (!update.fromCompact(commandParameters[1].data, commandParameters[1].length)) {
+				debuglog("\tInvalid data\n");
+				break;
+			}
+			Commands::setPeerProtocolVersion(serverConnectionHandlerID, clientID, PROTOCOL_VERSION_COMPACT);
+			// The compact encoding only carries ids, names of new ids are looked up locally by the remote name resolve thread
+			int unresolvedFields;
+			if (gw2RemoteInfoContainer.updateRemoteGW2Info(serverConnectionHandlerID, clientID, update, unresolvedFields)) {
+				if (update.fields & (GW2INFO_KEYFRAME | GW2INFO_FIELDS_RENDERED))
+					scheduleInfoPanelUpdate();
+				queueRemoteNameRequest(serverConnectionHandlerID, clientID, update, unresolvedFields);
+			} else {
+				// Missed an update, ask for a keyframe instead of waiting for the next periodic one
+				Commands::requestGW2InfoKeyframeFromClient(serverConnectionHandlerID, clientID);
+			}
 			break;
 		}
 		case Commands::CMD_REQUESTGW2INFO: {
-			if (commandParameters.size() != 1) {
-				debuglog("\tInvalid parameter count: %d\n", commandParameters.size());
+			if (command.parameterCount < 1 || command.parameterCount > 3) {
+				debuglog("\tInvalid parameter count: %d\n", command.parameterCount);
 				break;
 			}
-			debuglog("\tCommand: RequestGW2Info\n\tClient: %s\n", commandParameters.at(0).c_str());
+			debuglog("\tCommand: RequestGW2Info\n\tClient: %.*s\n", (int)commandParameters[0].length, commandParameters[0].data);
+
+			// Older plugin versions don't announce their protocol version
+			anyID clientID = (anyID)commandParameters[0].toInt();
+			int protocolVersion = command.parameterCount > 1 ? commandParameters[1].toInt() : PROTOCOL_VERSION_JSON;
+			int flags = command.parameterCount > 2 ? commandParameters[2].toInt() : 0;
+			Commands::setPeerProtocolVersion(serverConnectionHandlerID, clientID, protocolVersion);
 
-			anyID clientID = (anyID)atoi(commandParameters.at(0).c_str());
-			Commands::sendGW2Info(serverConnectionHandlerID, gw2Info, PluginCommandTarget_CLIENT, &clientID);
+			// Answered by the transmit thread, together with other requests that arrive at about the same time
+			Commands::subscribe(serverConnectionHandlerID, clientID);
+			Commands::queueGW2InfoReply(serverConnectionHandlerID, clientID, flags);
 			break;
 		}
 	}
 }
 
+static void stopThread(HANDLE hThread, const char* name) {
+	if (hThread == 0)
+		return;
+
+	bool threadClosed = false;
+	DWORD threadReturn = WaitForSingleObject(hThread, 1000);
+	switch (threadReturn) {
+		case WAIT_ABANDONED:
+			debuglog("\t%s thread has been abandoned\n", name);
+			break;
+		case WAIT_OBJECT_0:
+			debuglog("\t%s thread has exited\n", name);
+			CloseHandle(hThread);
+			threadClosed = true;
+			break;
+		case WAIT_TIMEOUT:
+			debuglog("\t%s thread has timed out\n", name);
+			break;
+		case WAIT_FAILED:
+			debuglog("\tWaiting on %s thread has failed: %d\n", name, GetLastError());
+			break;
+	}
+
+	/* In case the thread has not been exited within the given timeout, terminate it to prevent hanging */
+	if (!threadClosed) {
+		TerminateThread(hThread, 0);
+		CloseHandle(hThread);
+	}
+}
+
+/* Stops whichever threads have been started and closes their events, also used when ts3plugin_init fails halfway */
+static void stopThreads() {
+	/* The producer is stopped before its consumers */
+	threadStopRequested = true;
+	stopThread(hThread, "Guild Wars 2 checker");
+	stopThread(hResolveThread, "Guild Wars 2 resolver");
+	stopThread(hTransmitThread, "Guild Wars 2 transmitter");
+	stopThread(hRemoteNameResolveThread, "Guild Wars 2 remote name resolver");
+	hThread = hResolveThread = hTransmitThread = hRemoteNameResolveThread = 0;
+	CloseHandle(hLinkEventsAvailable);
+	CloseHandle(hTransmitRequestsAvailable);
+	CloseHandle(hRemoteNameRequestsAvailable);
+	hLinkEventsAvailable = hTransmitRequestsAvailable = hRemoteNameRequestsAvailable = 0;
+}
+
 void updateInfoPanel() {
 	if (infoDataType > 0 && infoDataId > 0) ts3Functions.requestInfoUpdate(ts3Functions.getCurrentServerConnectionHandlerID(), infoDataType, infoDataId);
 }
 
+/* Called from any thread after a record changed, the timer checks whether it's the one the info panel shows */
+static void scheduleInfoPanelUpdate() {
+	InterlockedExchange(&infoPanelUpdatePending, 1);
+}
+
+/*
+ * Only asks for the info of a client if there's no record that has been updated recently. A fresh record may still stop being
+ * updated, e.g. once the client left our channel, so the subscription to it is renewed if that's due.
+ */
+static void requestGW2InfoIfOutdated(uint64 serverConnectionHandlerID, anyID clientID) {
+	Gw2RemoteInfoContainer::Snapshot snapshot = gw2RemoteInfoContainer.getRemoteGW2InfoSnapshot(serverConnectionHandlerID, clientID);
+	if (snapshot && difftime(time(NULL), snapshot->updateTime) < GW2INFO_MAX_RECORD_AGE) {
+		debuglog("GW2Plugin: Info of client %d is still fresh\n", clientID);
+		Commands::renewSubscription(serverConnectionHandlerID, clientID);
+		return;
+	}
+	Commands::requestGW2InfoFromClient(serverConnectionHandlerID, clientID);
+}
+
+/* Only called from ts3plugin_onPluginCommandEvent, which makes it the only producer of the queue */
+static void queueRemoteNameRequest(uint64 serverConnectionHandlerID, anyID clientID, const Gw2InfoUpdate& update, int fields) {
+	// Offline records don't have anything to resolve
+	if (update.isKeyframe() && update.info.characterName.empty())
+		return;
+	RemoteNameRequest request;
+	request.serverConnectionHandlerID = serverConnectionHandlerID;
+	request.clientID = clientID;
+	request.fields = fields & (GW2INFO_FIELD_MAP | GW2INFO_FIELD_WAYPOINT);
+	request.mapId = update.info.mapId;
+	request.worldId = update.info.worldId;
+	request.waypointId = update.info.waypointId;
+	if (request.fields == 0)
+		return;
+
+	if (remoteNameRequests.push(request)) {
+		SetEvent(hRemoteNameRequestsAvailable);
+	} else {
+		debuglog("GW2Plugin: Remote name queue is full, client %d keeps placeholder names until its next keyframe\n", clientID);
+	}
+}
+
+/* Info panel timer, runs on the TeamSpeak thread that owns infoDataType and infoDataId */
+static void CALLBACK infoPanelTimer(HWND hwnd, UINT message, UINT_PTR timerID, DWORD tickCount) {
+	if (infoDataType != PLUGIN_CLIENT || infoDataId == 0)
+		return;
+	uint64 serverConnectionHandlerID = ts3Functions.getCurrentServerConnectionHandlerID();
+
+	// Only refresh if the record of the shown client changed since it was rendered
+	if (InterlockedExchange(&infoPanelUpdatePending, 0) != 0) {
+		Gw2RemoteInfoContainer::Snapshot snapshot = gw2RemoteInfoContainer.getRemoteGW2InfoSnapshot(serverConnectionHandlerID, (anyID)infoDataId);
+		uint32_t revision = snapshot ? snapshot->revision : 0;
+		if (revision != infoPanelRevision) {
+			infoPanelRevision = revision;
+			updateInfoPanel();
+		}
+	}
+
+	// Keeps the subscription to a shown client outside our channel alive for as long as it's shown
+	if (infoPanelRevision != 0)
+		Commands::renewSubscription(serverConnectionHandlerID, (anyID)infoDataId);
+}
+
 bool checkForUpdates() {
 #ifndef _DEBUG
 	HANDLE hThread = CreateThread(NULL, 0, checkForUpdatesAsync, NULL, 0, NULL);
@@ -387,24 +576,57 @@ DWORD WINAPI checkForUpdatesAsync(LPVOID lpParam) {
 }
 
 
+// Returns false if the queue is full, the caller keeps its previous state then so the change is detected again on the next poll
+static bool emitLinkEvent(LinkEventType type, const LinkEvent& state) {
+	LinkEvent event = state;
+	event.type = type;
+	if (!linkEvents.push(event)) {
+		debuglog("GW2Plugin: Link event queue is full, deferred event %d\n", type);
+		return false;
+	}
+	SetEvent(hLinkEventsAvailable);
+	return true;
+}
+
 DWORD WINAPI mumbleLinkCheckLoop(LPVOID lpParam) {
-	Gw2Api::MumbleLink::initLink();
-	debuglog("GW2Plugin: Mumble Link created\n");
+	Gw2Api::MumbleLink::LinkSource* linkSource = NULL;
+	Gw2Api::MumbleLink::TraceRecorder traceRecorder;
+	if (!Globals::mumbleLinkReplayFile.empty()) {
+		linkSource = new Gw2Api::MumbleLink::ReplayLinkSource(Globals::mumbleLinkReplayFile, Globals::mumbleLinkReplaySpeed);
+		if (linkSource->open()) {
+			debuglog("GW2Plugin: Replaying Mumble Link trace %s\n", Globals::mumbleLinkReplayFile.c_str());
+		} else {
+			delete linkSource;
+			linkSource = NULL;
+		}
+	}
+	if (linkSource == NULL) {
+		linkSource = Gw2Api::MumbleLink::createSharedMemoryLinkSource();
+		if (linkSource->open()) {
+			debuglog("GW2Plugin: Mumble Link created\n");
+		} else {
+			debuglog("GW2Plugin: Could not create Mumble Link\n");
+		}
+		if (!Globals::mumbleLinkRecordFile.empty() && traceRecorder.open(Globals::mumbleLinkRecordFile)) {
+			debuglog("GW2Plugin: Recording Mumble Link trace to %s\n", Globals::mumbleLinkRecordFile.c_str());
+		}
+	}
+	Gw2Api::MumbleLink::attachLink(linkSource->getLinkedMem());
 
-	time_t lastMumbleLinkUpdate = 0;
-	time_t lastTransmissionTime = 0;
 	time_t lastOffline = 0;
 
 	bool linked = false;
 	bool prevIsOnline = false;
-	Gw2Api::MumbleLink::MumbleIdentity prevIdentity;
-	Gw2Api::Vector3D prevAvatarPosition;
-	Gw2Api::Vector2D prevDistancePosition;
+	LinkEvent prevState;
 
 	while (!threadStopRequested) {
+		linkSource->update();
+		if (traceRecorder.isOpen()) {
+			traceRecorder.record(Gw2Api::MumbleLink::getLinkedMem());
+		}
+
 		// Check if Guild Wars 2 is active through Mumble Link (it only gets updated when IN-game, so not in character screen, loading screens, etc.)
 		bool newIsOnline = Gw2Api::MumbleLink::isActive() && Gw2Api::MumbleLink::isGW2();
-		bool updated = false;
 		
 		if (newIsOnline) {
 			if (!prevIsOnline && difftime(time(NULL), lastOffline) >= Globals::onlineStateTransmissionThreshold) {
@@ -413,91 +635,36 @@ DWORD WINAPI mumbleLinkCheckLoop(LPVOID lpParam) {
 			}
 
 			lastOffline = 0; // Reset last offline time
-			Gw2Api::MumbleLink::MumbleIdentity newIdentity = Gw2Api::MumbleLink::getIdentity();
-			Gw2Api::Vector3D newAvatarPosition = Gw2Api::MumbleLink::getAvatarPosition();
-
-			if (newIdentity != prevIdentity) {
-				// New identity from Mumble Link -> update
+			LinkEvent newState;
+			newState.time = time(NULL);
+			newState.identity = Gw2Api::MumbleLink::getIdentity();
+			newState.avatarPosition = Gw2Api::MumbleLink::getAvatarPosition();
+			newState.context = Gw2Api::MumbleLink::getContextSnapshot();
+
+			// Every part of prevState only advances once its event is queued, a dropped change is emitted again on the next poll
+			if (newState.identity != prevState.identity) {
 				debuglog("GW2Plugin: New Guild Wars 2 identity\n");
-				gw2Info.characterName = newIdentity.name;
-				gw2Info.profession = newIdentity.profession;
-				gw2Info.mapId = newIdentity.map_id;
-				gw2Info.worldId = newIdentity.world_id;
-				gw2Info.teamColorId = newIdentity.team_color_id;
-				gw2Info.commander = newIdentity.commander;
-
-				// Get relevant names of the map, region and continent here, since getting it asynchronously upon receiving a command
-				// and requesting a right panel update seems to crash TS3 with an access violation
-				// TODO: This needs further investigation, because although getting relevant info here is a nice workaround,
-				//       it is not ideal (too much transfer data overhead)
-				Gw2Api::ApiInnerResponseObject<Gw2Api::MapsRootEntry, Gw2Api::MapEntry> map;
-				if (Gw2Api::getMap(gw2Info.mapId, &map)) {
-					gw2Info.mapName = map.value.map_name;
-					gw2Info.regionId = map.value.region_id;
-					gw2Info.regionName = map.value.region_name;
-					gw2Info.continentId = map.value.continent_id;
-					gw2Info.continentName = map.value.continent_name;
-				} else {
-					gw2Info.mapName = "Map " + to_string(gw2Info.mapId);
-					gw2Info.regionId = 0;
-					gw2Info.regionName = "Unknown region";
-					gw2Info.continentId = 0;
-					gw2Info.continentName = "Unknown continent";
-				}
-
-				// Same comments + TODO as the previous code block: getting the world name here is not ideal
-				Gw2Api::WorldNamesRootEntry worldNames;
-				if (Gw2Api::getWorldNames(&worldNames) && worldNames.world_names.find(gw2Info.worldId) != worldNames.world_names.end()) {
-					gw2Info.worldName = worldNames.world_names[gw2Info.worldId].name;
-				} else {
-					gw2Info.worldName = "World " + to_string(gw2Info.worldId);
-				}
-
-				if (difftime(time(NULL), lastTransmissionTime) >= Globals::locationTransmissionThreshold) {
-					// Update timeout threshold exceeded -> update
-					updated = true;
-				}
+				if (emitLinkEvent(LINKEVENT_IDENTITYCHANGED, newState))
+					prevState.identity = newState.identity;
 			}
 
-			if (newAvatarPosition != prevAvatarPosition) {
-				// New position from Mumble Link -> update
-				debuglog("GW2Plugin: New Guild Wars 2 position\n");
-
-				// Calculate continent position
-				Gw2Api::ApiInnerResponseObject<Gw2Api::MapsRootEntry, Gw2Api::MapEntry> map;
-				if (Gw2Api::getMap(gw2Info.mapId, &map)) {
-					Gw2Api::Gw2Position position = Gw2Api::Gw2Position(newAvatarPosition, Gw2Api::Gw2Position::Mumble,
-						gw2Info.mapId, map.value.map_rect, map.value.continent_rect).toContinentPosition();
-					gw2Info.characterContinentPosition = position.position;
-				}
-
-				// Calculate closest waypoint nearby
-				// Same comments + TODO as a couple of code blocks back: getting the waypoint name here is not ideal
-				Gw2Api::PointOfInterestEntry waypoint;
-				if (getClosestWaypoint(gw2Info.characterContinentPosition, gw2Info.mapId, &waypoint)) {
-					gw2Info.waypointId = waypoint.poi_id;
-					if (!waypoint.name.empty()) {
-						gw2Info.waypointName = waypoint.name;
-					} else {
-						gw2Info.waypointName = "Waypoint " + to_string(gw2Info.waypointId);
-					}
-					gw2Info.waypointContinentPosition = waypoint.coord;
-				} else {
-					gw2Info.waypointId = 0;
-					gw2Info.waypointName = "";
-					gw2Info.waypointContinentPosition = Gw2Api::Vector2D();
-				}
+			int contextChanges = Gw2Api::MumbleLink::getContextChanges(prevState.context, newState.context);
+			if (contextChanges & (Gw2Api::MumbleLink::ShardChanged | Gw2Api::MumbleLink::InstanceChanged)) {
+				// Same map but a different copy of it (e.g. overflow or another instance)
+				debuglog("GW2Plugin: New Guild Wars 2 map instance (shard %u, instance %u, server %s)\n",
+					newState.context.shardId, newState.context.instance, newState.context.serverAddress.toString().c_str());
+				if (emitLinkEvent(LINKEVENT_INSTANCECHANGED, newState))
+					prevState.context = newState.context;
+			} else {
+				prevState.context = newState.context;
+			}
 
-				if (difftime(time(NULL), lastTransmissionTime) >= Globals::locationTransmissionThreshold &&
-					newAvatarPosition.toVector2D().getDistance(prevDistancePosition) >= Globals::distanceTransmissionThreshold) {
-					// Update timeout and distance threshold exceeded -> update
-					prevDistancePosition = newAvatarPosition.toVector2D();
-					updated = true;
-				}
+			if (newState.avatarPosition != prevState.avatarPosition) {
+				if (emitLinkEvent(LINKEVENT_MOVED, newState))
+					prevState.avatarPosition = newState.avatarPosition;
 			}
 
-			prevIdentity = newIdentity;
-			prevAvatarPosition = newAvatarPosition;
+			prevState.time = newState.time;
 		} else {
 			if (prevIsOnline) {
 				lastOffline = time(NULL); // Remember "offline" time (timeout just to eleminate possible framerate lag, short loading screens, etc.)
@@ -505,21 +672,220 @@ DWORD WINAPI mumbleLinkCheckLoop(LPVOID lpParam) {
 			}
 
 			if (linked && difftime(time(NULL), lastOffline) >= Globals::onlineStateTransmissionThreshold) {
-				// Offline threshold exceeded -> update
-				debuglog("GW2Plugin: Guild Wars 2 unlinked\n");
-				linked = false;
-				gw2Info.clear();
-				updated = true;
+				// Offline threshold exceeded
+				LinkEvent offlineState;
+				offlineState.time = time(NULL);
+				if (emitLinkEvent(LINKEVENT_WENTOFFLINE, offlineState)) {
+					debuglog("GW2Plugin: Guild Wars 2 unlinked\n");
+					linked = false;
+					prevState = offlineState; // Makes sure everything gets resolved again when Guild Wars 2 is linked again
+				}
 			}
 		}
 		prevIsOnline = newIsOnline;
 
-		if (updated) {
-			lastTransmissionTime = time(NULL);
-			Commands::sendGW2Info(ts3Functions.getCurrentServerConnectionHandlerID(), gw2Info, PluginCommandTarget_SERVER, NULL);
+		Sleep(50); // Wait a bit so we are not uselessly looping when Guild Wars 2 hasn't updated Mumble Link yet (it updates once per frame)
+	}
+
+	Gw2Api::MumbleLink::attachLink(NULL);
+	linkSource->close();
+	delete linkSource;
+	return 0;
+}
+
+static void resolveIdentity(const Gw2Api::MumbleLink::MumbleIdentity& identity, Gw2Info& info) {
+	info.characterName = identity.name;
+	info.profession = identity.profession;
+	info.mapId = identity.map_id;
+	info.worldId = identity.world_id;
+	info.teamColorId = identity.team_color_id;
+	info.commander = identity.commander;
+
+	// The names are only transmitted in the JSON encoding for older plugin versions, which don't resolve them on receive
+	info.resolveMapNames();
+}
+
+static void resolvePosition(const Gw2Api::Vector3D& avatarPosition, Gw2Info& info) {
+	// Calculate continent position
+	Gw2Api::ApiInnerResponseObject<Gw2Api::MapsRootEntry, Gw2Api::MapEntry> map;
+	if (Gw2Api::getMap(info.mapId, &map)) {
+		Gw2Api::Gw2Position position = Gw2Api::Gw2Position(avatarPosition, Gw2Api::Gw2Position::Mumble,
+			info.mapId, map.value.map_rect, map.value.continent_rect).toContinentPosition();
+		info.characterContinentPosition = position.position;
+	}
+
+	// Calculate closest waypoint nearby
+	// The name is only transmitted in the JSON encoding, the compact encoding leaves it to the receiver
+	Gw2Api::PointOfInterestEntry waypoint;
+	if (getClosestWaypoint(info.characterContinentPosition, info.mapId, &waypoint)) {
+		info.waypointId = waypoint.poi_id;
+		if (!waypoint.name.empty()) {
+			info.waypointName = waypoint.name;
+		} else {
+			info.waypointName = "Waypoint " + to_string(info.waypointId);
 		}
+		info.waypointContinentPosition = waypoint.coord;
+	} else {
+		info.waypointId = 0;
+		info.waypointName = "";
+		info.waypointContinentPosition = Gw2Api::Vector2D();
+	}
+}
 
-		Sleep(50); // Wait a bit so we are not uselessly looping when Guild Wars 2 hasn't updated Mumble Link yet (it updates once per frame)
+DWORD WINAPI gw2InfoResolveLoop(LPVOID lpParam) {
+	Gw2Info info;
+
+	while (!threadStopRequested) {
+		WaitForSingleObject(hLinkEventsAvailable, 100);
+
+		// Drain the queue first; positions only have to be resolved once for the most recent movement
+		int reasons = 0;
+		bool moved = false;
+		LinkEvent event;
+		LinkEvent lastMove;
+		while (linkEvents.pop(event)) {
+			switch (event.type) {
+				case LINKEVENT_IDENTITYCHANGED:
+					resolveIdentity(event.identity, info);
+					reasons |= TRANSMIT_IDENTITY;
+					break;
+				case LINKEVENT_INSTANCECHANGED:
+					info.mapShardId = event.context.shardId;
+					info.mapInstance = event.context.instance;
+					reasons |= TRANSMIT_INSTANCE;
+					break;
+				case LINKEVENT_MOVED:
+					lastMove = event;
+					moved = true;
+					break;
+				case LINKEVENT_WENTOFFLINE:
+					info.clear();
+					moved = false;
+					reasons = TRANSMIT_OFFLINE;
+					break;
+			}
+		}
+		if (moved) {
+			resolvePosition(lastMove.avatarPosition, info);
+			reasons |= TRANSMIT_POSITION;
+		}
+		if (reasons == 0)
+			continue;
+
+		EnterCriticalSection(&gw2InfoCs);
+		gw2Info = info;
+		LeaveCriticalSection(&gw2InfoCs);
+
+		TransmitRequest request;
+		request.reasons = reasons;
+		request.gw2Info = info;
+		request.avatarPosition = lastMove.avatarPosition.toVector2D();
+		if (transmitRequests.push(request)) {
+			SetEvent(hTransmitRequestsAvailable);
+		} else {
+			debuglog("GW2Plugin: Transmit queue is full, dropped update\n");
+		}
+	}
+	return 0;
+}
+
+DWORD WINAPI gw2InfoTransmitLoop(LPVOID lpParam) {
+	bool transmitted = false;
+	DWORD lastTransmissionTicks = 0;
+	Gw2Api::Vector2D lastTransmissionPosition;
+
+	int pendingReasons = 0;
+	TransmitRequest pending;
+	Gw2Api::Vector2D pendingPosition;
+
+	while (!threadStopRequested) {
+		// Also wake up regularly for queued replies, and exactly when a held back identity or instance change becomes due
+		DWORD thresholdTicks = (DWORD)Globals::locationTransmissionThreshold * 1000;
+		DWORD elapsed = GetTickCount() - lastTransmissionTicks;
+		bool timeExceeded = !transmitted || elapsed >= thresholdTicks;
+		DWORD timeout = 250;
+		if ((pendingReasons & (TRANSMIT_IDENTITY | TRANSMIT_INSTANCE)) && !timeExceeded && thresholdTicks - elapsed < timeout)
+			timeout = thresholdTicks - elapsed;
+		WaitForSingleObject(hTransmitRequestsAvailable, timeout);
+
+		TransmitRequest request;
+		while (transmitRequests.pop(request)) {
+			pendingReasons |= request.reasons;
+			if (request.reasons & TRANSMIT_POSITION)
+				pendingPosition = request.avatarPosition;
+			pending = request;
+		}
+		// The last request always carries the latest info
+		Commands::sendQueuedGW2InfoReplies(pending.gw2Info);
+		if (pendingReasons == 0)
+			continue;
+
+		elapsed = GetTickCount() - lastTransmissionTicks;
+		timeExceeded = !transmitted || elapsed >= thresholdTicks;
+		bool transmit = false;
+		if (pendingReasons & TRANSMIT_OFFLINE) {
+			// Offline threshold has already been applied by the Mumble Link thread
+			transmit = true;
+		} else if (pendingReasons & (TRANSMIT_IDENTITY | TRANSMIT_INSTANCE)) {
+			transmit = timeExceeded;
+		} else if (timeExceeded) {
+			transmit = pendingPosition.getDistance(lastTransmissionPosition) >= Globals::distanceTransmissionThreshold;
+			if (!transmit)
+				pendingReasons = 0; // Not moved far enough, wait for the next movement
+		}
+
+		if (transmit) {
+			transmitted = true;
+			lastTransmissionTicks = GetTickCount();
+			lastTransmissionPosition = pendingPosition;
+			pendingReasons = 0;
+			Commands::sendGW2Info(ts3Functions.getCurrentServerConnectionHandlerID(), pending.gw2Info, PluginCommandTarget_SERVER, NULL);
+		}
+	}
+	return 0;
+}
+
+DWORD WINAPI gw2RemoteNameResolveLoop(LPVOID lpParam) {
+	Gw2NameIndex nameIndex;
+	vector<RemoteNameRequest> requests;
+	vector<int> mapIds;
+	vector<int> worldIds;
+
+	while (!threadStopRequested) {
+		WaitForSingleObject(hRemoteNameRequestsAvailable, 250);
+
+		requests.clear();
+		RemoteNameRequest request;
+		while (remoteNameRequests.pop(request))
+			requests.push_back(request);
+		if (requests.empty())
+			continue;
+
+		// Look up all maps and worlds of this batch at once, e.g. when joining a channel full of players
+		mapIds.clear();
+		worldIds.clear();
+		for (size_t i = 0; i < requests.size(); i++) {
+			if (requests[i].fields & GW2INFO_FIELD_MAP) {
+				mapIds.push_back(requests[i].mapId);
+				worldIds.push_back(requests[i].worldId);
+			}
+		}
+		nameIndex.prefetch(mapIds, worldIds);
+
+		for (size_t i = 0; i < requests.size() && !threadStopRequested; i++) {
+			Gw2Info names;
+			names.mapId = requests[i].mapId;
+			names.worldId = requests[i].worldId;
+			names.waypointId = requests[i].waypointId;
+			if (requests[i].fields & GW2INFO_FIELD_MAP)
+				nameIndex.resolveMapNames(names);
+			if (requests[i].fields & GW2INFO_FIELD_WAYPOINT)
+				nameIndex.resolveWaypoint(names);
+
+			// Only flags the change, the info panel timer refreshes the panel if it shows this client
+			if (gw2RemoteInfoContainer.updateRemoteGW2InfoNames(requests[i].serverConnectionHandlerID, requests[i].clientID, names, requests[i].fields))
+				scheduleInfoPanelUpdate();
+		}
 	}
 	return 0;
 }
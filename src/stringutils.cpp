@@ -34,6 +34,33 @@ void split(const string &s, char delim, size_t limit, vector<string> &elems) {
 	}
 }
 
+size_t split(const char* s, char delim, size_t limit, StringRef* tokens) {
+	size_t count = 0;
+	while (*s != 0 && count < limit) {
+		const char* end = strchr(s, delim);
+		if (end == NULL || count + 1 >= limit) {
+			tokens[count++] = StringRef(s, strlen(s));
+			break;
+		}
+
+		tokens[count++] = StringRef(s, end - s);
+		s = end + 1;
+	}
+	return count;
+}
+
+int StringRef::toInt() const {
+	size_t i = 0;
+	bool negative = length > 0 && data[0] == '-';
+	if (negative)
+		i++;
+
+	int value = 0;
+	for (; i < length && data[i] >= '0' && data[i] <= '9'; i++)
+		value = value * 10 + (data[i] - '0');
+	return negative ? -value : value;
+}
+
 void split(const string &s, char delim, vector<string> &elems) {
 	split(s, delim, 0, elems);
 }
@@ -13,8 +13,36 @@
 #pragma once
 #include <string>
 #include <stdint.h>
+#include <string.h>
 #include <vector>
 
+/* Non-owning reference to a range of characters within a larger string */
+struct StringRef {
+	const char* data;
+	size_t length;
+
+	StringRef() {
+		data = NULL;
+		length = 0;
+	}
+	StringRef(const char* data, size_t length) {
+		this->data = data;
+		this->length = length;
+	}
+
+	bool empty() const { return length == 0; }
+	bool equals(const char* s) const { return strncmp(data, s, length) == 0 && s[length] == 0; }
+	std::string str() const { return std::string(data, length); }
+	/* Parses a decimal number like atoi, but stops at the end of the range */
+	int toInt() const;
+};
+
+/*
+ * Splits a zero-terminated string into at most limit tokens without copying, the last token holds the remainder of the string
+ * (and is therefore zero-terminated as well). Returns the number of tokens, behaves like split otherwise.
+ */
+size_t split(const char* s, char delim, size_t limit, StringRef* tokens);
+
 void split(const std::string &s, char delim, size_t limit, std::vector<std::string> &elems);
 void split(const std::string &s, char delim, std::vector<std::string> &elems);
 std::vector<std::string> split(const std::string &s, char delim, int limit);
@@ -0,0 +1,177 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+*/
+
+/*
+ * Standalone driver for Mumble Link traces, it doesn't need the game, TeamSpeak or the plugin.
+ * It polls a replayed trace with the same change detection as mumbleLinkCheckLoop and reports the events and the
+ * time spent per poll. With --shm every replayed frame is also written into the shared memory link of the platform
+ * (/dev/shm/MumbleLink.<uid> on POSIX systems), so it can stand in for the game for any other reader.
+ *
+ * Not part of the plugin project, build it on its own, e.g. on Linux:
+ *   g++ -O2 -std=gnu++11 -I src -I dependencies src/tools/mumblelinkreplay.cpp -o mumblelinkreplay -lrt
+ *
+ * Usage: mumblelinkreplay <trace> [--speed <factor>] [--poll <ms>] [--shm] [--quiet]
+ *   --speed  1 replays in real time (default), higher values replay accelerated, 0 applies one frame per poll
+ *   --poll   Milliseconds between polls, defaults to 50 like the plugin; 0 polls as fast as possible
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
+#include "gw2api/mumblelink.h"
+#include "gw2api/mumblelinksource.h"
+#include "gw2api/mumblelinktrace.h"
+using namespace std;
+using namespace Gw2Api;
+using namespace Gw2Api::MumbleLink;
+
+static double getMicroseconds() {
+#ifdef _WIN32
+	LARGE_INTEGER frequency, counter;
+	QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart * 1000000.0 / (double)frequency.QuadPart;
+#else
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1000000.0 + (double)ts.tv_nsec / 1000.0;
+#endif
+}
+
+static void sleepMilliseconds(unsigned ms) {
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	usleep(ms * 1000);
+#endif
+}
+
+static int printUsage() {
+	fprintf(stderr, "Usage: mumblelinkreplay <trace> [--speed <factor>] [--poll <ms>] [--shm] [--quiet]\n");
+	return 2;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2)
+		return printUsage();
+
+	string tracePath = argv[1];
+	double speed = 1;
+	unsigned pollInterval = 50;
+	bool writeShm = false;
+	bool quiet = false;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+			speed = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--poll") == 0 && i + 1 < argc) {
+			pollInterval = (unsigned)atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--shm") == 0) {
+			writeShm = true;
+		} else if (strcmp(argv[i], "--quiet") == 0) {
+			quiet = true;
+		} else {
+			return printUsage();
+		}
+	}
+
+	TraceReplayer replayer;
+	if (!replayer.open(tracePath, speed)) {
+		fprintf(stderr, "Could not open trace %s\n", tracePath.c_str());
+		return 1;
+	}
+
+	LinkSource* shmSource = NULL;
+	if (writeShm) {
+		shmSource = createSharedMemoryLinkSource();
+		if (!shmSource->open()) {
+			fprintf(stderr, "Could not open the shared memory link\n");
+			delete shmSource;
+			return 1;
+		}
+	}
+
+	attachLink(replayer.getLinkedMem());
+
+	unsigned long polls = 0;
+	unsigned long activePolls = 0;
+	unsigned long identityChanges = 0;
+	unsigned long instanceChanges = 0;
+	unsigned long moves = 0;
+	double totalPollTime = 0;
+	double maxPollTime = 0;
+
+	bool prevIsOnline = false;
+	MumbleIdentity prevIdentity;
+	MumbleContextSnapshot prevContext;
+	Vector3D prevPosition;
+
+	while (replayer.update()) {
+		if (shmSource != NULL)
+			memcpy(shmSource->getLinkedMem(), replayer.getLinkedMem(), sizeof(LinkedMem));
+
+		// Same checks as mumbleLinkCheckLoop, without resolving or transmitting anything
+		double pollStart = getMicroseconds();
+		bool newIsOnline = isActive() && isGW2();
+		if (newIsOnline) {
+			activePolls++;
+			MumbleIdentity identity = getIdentity();
+			MumbleContextSnapshot context = getContextSnapshot();
+			Vector3D position = getAvatarPosition();
+
+			if (identity != prevIdentity) {
+				identityChanges++;
+				if (!quiet)
+					printf("%8lu identity: %s, map %u, world %u\n", polls, identity.name.c_str(), identity.map_id, identity.world_id);
+			}
+			if (getContextChanges(prevContext, context) & (ShardChanged | InstanceChanged)) {
+				instanceChanges++;
+				if (!quiet)
+					printf("%8lu instance: shard %u, instance %u, server %s\n", polls, context.shardId, context.instance, context.serverAddress.toString().c_str());
+			}
+			if (position != prevPosition)
+				moves++;
+
+			prevIdentity = identity;
+			prevContext = context;
+			prevPosition = position;
+		} else if (prevIsOnline && !quiet) {
+			printf("%8lu offline\n", polls);
+		}
+		prevIsOnline = newIsOnline;
+
+		double pollTime = getMicroseconds() - pollStart;
+		totalPollTime += pollTime;
+		if (pollTime > maxPollTime)
+			maxPollTime = pollTime;
+		polls++;
+
+		if (pollInterval > 0)
+			sleepMilliseconds(pollInterval);
+	}
+
+	attachLink(NULL);
+	if (shmSource != NULL) {
+		shmSource->close();
+		delete shmSource;
+	}
+
+	printf("%lu polls (%lu active): %lu identity changes, %lu instance changes, %lu moves\n", polls, activePolls, identityChanges, instanceChanges, moves);
+	printf("Poll time: %.2f us average, %.2f us max\n", polls > 0 ? totalPollTime / polls : 0.0, maxPollTime);
+	return 0;
+}